@@ -1,384 +1,2099 @@
+#define _POSIX_C_SOURCE 200809L  ///< Declares the POSIX functions used, such as strtok_r, getline and clock_gettime, under -std=c11.
+
+#include <fcntl.h>
 #include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define THREAT_LANES 32  ///< Windows evaluated at once by the threat map.
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define THREAT_LANES 16  ///< Windows evaluated at once by the threat map.
+#else
+#define THREAT_LANES 1  ///< Windows evaluated at once by the threat map.
+#endif
 
 /**
- * @brief The player structure.
+ * @brief Enables the tracking allocator.
  *
- * This structure contains all the information about a registered player.
+ * When set to 0 (e.g., gcc -DMEM_TRACKING=0), the tracking macros map directly
+ * to malloc, realloc and free, and no statistics are recorded.
  */
-typedef struct {
-    char* name;        ///< The name of the player.
-    int games_played;  ///< The number of games played by the player.
-    int wins;          ///< The number of games won by the player.
-} tPlayer, *pPlayer;
+#ifndef MEM_TRACKING
+#define MEM_TRACKING 1
+#endif
+
+#define MEM_MAX_COMMANDS 32  ///< Maximum number of distinct tracked instructions.
+#define MEM_MAX_SITES 128    ///< Maximum number of distinct tracked call sites.
 
 /**
- * @brief The in-game player structure.
+ * @brief Allocation statistics.
  *
- * This structure contains all the information about a player in a game.
+ * This structure accumulates the allocations performed by an instruction, or
+ * at a call site.
  */
 typedef struct {
-    pPlayer player;             ///< Pointer to the player structure.
-    int* special_sequences;     ///< Array of special sequences.
-    int num_special_sequences;  ///< The number of special sequences.
-} tInGamePlayer, *pInGamePlayer;
+    long calls;         ///< The number of malloc/realloc calls.
+    long bytes;         ///< The total number of bytes requested.
+    long live_bytes;    ///< The number of bytes currently allocated.
+    long peak_bytes;    ///< The maximum value reached by live_bytes.
+} tMemStats, *pMemStats;
 
 /**
- * @brief The game structure.
+ * @brief The allocation statistics of an instruction.
+ */
+typedef struct {
+    char name[8];     ///< The instruction, as read from the input (e.g., "RJ").
+    tMemStats stats;  ///< The statistics of the instruction.
+} tMemCommand;
+
+/**
+ * @brief The allocation statistics of a call site.
  *
- * This structure contains all the information about the game.
+ * Call sites are keyed by function only, so that the summary does not change
+ * when unrelated code moves the lines of a function.
  */
 typedef struct {
-    pPlayer* players;           ///< Array of registered players.
-    int num_players;            ///< The number of registered players.
-    int width;                  ///< The width of the board.
-    int height;                 ///< The height of the board.
-    int sequence_size;          ///< The size of the winning sequence.
-    int* special_sequences;     ///< Array of special sequences.
-    int num_special_sequences;  ///< The number of special sequences.
-    pInGamePlayer player1;      ///< Pointer to the first player.
-    pInGamePlayer player2;      ///< Pointer to the second player.
-    pInGamePlayer** board;      ///< The board, with dimensions height x width.
-} tGame, *pGame;
+    const char* function;  ///< The function where the allocation is made.
+    tMemStats stats;       ///< The statistics of the call site.
+} tMemSite;
 
 /**
- * @brief Create and initialize a new game.
+ * @brief The tracking allocator state.
  *
- * This function creates and initializes a new game, allocating memory for the
- * structure. It is the responsibility of the caller to free this memory.
+ * Statistics are recorded per instruction, and per call site. Allocations made
+ * outside of an instruction are recorded under the "-" instruction. Each
+ * thread allocates on its current tracker, which is the process tracker unless
+ * the thread runs a batch session, or works for one (see mem_use_tracker). A
+ * tracker may be shared by several threads, and is protected by its lock.
+ */
+typedef struct tMemTracker {
+    pthread_mutex_t lock;                     ///< Protects the tracker.
+    tMemStats total;                          ///< Statistics of all allocations.
+    long limit;                               ///< Maximum number of live bytes, 0 for no limit.
+    tMemCommand commands[MEM_MAX_COMMANDS];   ///< Statistics per instruction.
+    int num_commands;                         ///< The number of tracked instructions.
+    tMemSite sites[MEM_MAX_SITES];            ///< Statistics per call site.
+    int num_sites;                            ///< The number of tracked call sites.
+} tMemTracker;
+
+/**
+ * @brief Header stored before every tracked allocation.
  *
- * @return pGame Pointer to a malloc reserved tGame structure.
+ * It records the size of the block and who allocated it, so that the block can
+ * be accounted for when it is released. The union with max_align_t keeps the
+ * user block suitably aligned.
  */
-pGame new_game() {
-    pGame game = malloc(sizeof(tGame));
-    game->players = NULL;
-    game->num_players = 0;
-    game->player1 = NULL;
-    game->player2 = NULL;
-    game->special_sequences = NULL;
-    game->width = -1;
-    game->height = -1;
-    game->sequence_size = -1;
-    game->num_special_sequences = 0;
-    game->board = NULL;
-    return game;
+typedef union {
+    struct {
+        size_t size;                  ///< The size of the user block.
+        struct tMemTracker* tracker;  ///< The tracker the block is accounted on.
+        int command;                  ///< Index of the instruction that allocated the block.
+        int site;                     ///< Index of the call site that allocated the block.
+    } info;
+    max_align_t align;  ///< Alignment of the user block.
+} tMemHeader;
+
+static tMemTracker mem_tracker = {.lock = PTHREAD_MUTEX_INITIALIZER, .num_commands = 1, .commands = {{"-"}}};  ///< The process tracker.
+static _Thread_local tMemTracker* mem_current_tracker = &mem_tracker;  ///< The tracker of the allocations of this thread.
+static _Thread_local int mem_current_command = 0;  ///< Index of the instruction being executed by this thread.
+
+/**
+ * @brief Initialize a tracker with no allocations.
+ *
+ * @param tracker Pointer to a tMemTracker structure.
+ * @param limit The maximum number of live bytes, 0 for no limit.
+ */
+void mem_init_tracker(tMemTracker* tracker, long limit) {
+    memset(tracker, 0, sizeof(tMemTracker));
+    pthread_mutex_init(&tracker->lock, NULL);
+    tracker->limit = limit;
+    tracker->num_commands = 1;
+    strcpy(tracker->commands[0].name, "-");
 }
 
 /**
- * @brief Frees the memory associated to a tGame.
+ * @brief Make subsequent allocations of this thread use a tracker.
  *
- * This function frees the memory associated to a tGame, and dependencies.
+ * Allocations are attributed to the "-" instruction until the next
+ * mem_set_command. Blocks are released on the tracker they were allocated on.
  *
- * @param game Pointer to a tGame structure.
+ * @param tracker Pointer to a tMemTracker structure.
  */
-void free_game(pGame game) {
-    for (int i = 0; i < game->num_players; i++) {
-        free(game->players[i]->name);
-        free(game->players[i]);
+void mem_use_tracker(tMemTracker* tracker) {
+    mem_current_tracker = tracker;
+    mem_current_command = 0;
+}
+
+/**
+ * @brief Get the tracker of the allocations of this thread.
+ *
+ * @return tMemTracker* The current tracker.
+ */
+tMemTracker* mem_get_tracker(void) {
+    return mem_current_tracker;
+}
+
+/**
+ * @brief Set the instruction to which subsequent allocations are attributed.
+ *
+ * @param name The instruction, as read from the input.
+ */
+void mem_set_command(const char* name) {
+    tMemTracker* tracker = mem_current_tracker;
+    pthread_mutex_lock(&tracker->lock);
+    mem_current_command = -1;
+    for (int i = 0; i < tracker->num_commands && mem_current_command == -1; i++) {
+        if (strncmp(tracker->commands[i].name, name, sizeof(tracker->commands[i].name) - 1) == 0) {
+            mem_current_command = i;
+        }
     }
-    if (game->num_players > 0) {
-        free(game->players);
+    if (mem_current_command == -1 && tracker->num_commands == MEM_MAX_COMMANDS) {
+        mem_current_command = 0;
+    } else if (mem_current_command == -1) {
+        tMemCommand* command = &tracker->commands[tracker->num_commands];
+        strncpy(command->name, name, sizeof(command->name) - 1);
+        mem_current_command = tracker->num_commands++;
     }
-    if (game->player1 != NULL) {
-        free(game->player1->special_sequences);
-        free(game->player1);
+    pthread_mutex_unlock(&tracker->lock);
+}
+
+/**
+ * @brief Get the index of a call site, registering it if needed.
+ *
+ * Call sites are identified by function name. If the table is full, the
+ * allocation is only recorded in the totals, and -1 is returned.
+ *
+ * @param tracker Pointer to a tMemTracker structure, with its lock held.
+ * @param function The function where the allocation is made.
+ * @return int The index of the call site, or -1.
+ */
+int mem_site_idx(tMemTracker* tracker, const char* function) {
+    for (int i = 0; i < tracker->num_sites; i++) {
+        if (strcmp(tracker->sites[i].function, function) == 0) {
+            return i;
+        }
     }
-    if (game->player2 != NULL) {
-        free(game->player2->special_sequences);
-        free(game->player2);
+    if (tracker->num_sites == MEM_MAX_SITES) {
+        return -1;
     }
-    if (game->special_sequences != NULL) {
-        free(game->special_sequences);
+    tracker->sites[tracker->num_sites].function = function;
+    return tracker->num_sites++;
+}
+
+/**
+ * @brief Update a set of statistics with an allocation, or release.
+ *
+ * @param stats Pointer to a tMemStats structure.
+ * @param requested The number of bytes requested, 0 for releases.
+ * @param delta The change to the number of live bytes.
+ * @param count Whether the operation counts as an allocation call.
+ */
+void mem_account(pMemStats stats, size_t requested, long delta, bool count) {
+    if (count) {
+        stats->calls++;
+        stats->bytes += requested;
     }
-    if (game->board != NULL) {
-        for (int r = 0; r < game->height; r++) {
-            free(game->board[r]);
-        }
-        free(game->board);
+    stats->live_bytes += delta;
+    if (stats->live_bytes > stats->peak_bytes) {
+        stats->peak_bytes = stats->live_bytes;
     }
-    free(game);
 }
 
 /**
- * @brief Get the player idx object
+ * @brief Update all statistics related to a block, on its tracker.
  *
- * This function returns the index of the player in the game->players array, or
- * -1 if not found.
+ * Must be called with the lock of the tracker held.
  *
- * @param game Pointer to a tGame structure.
- * @param name The name of the player.
- * @return int The index of the player in the game->players array, or -1 if not
- * found.
+ * @param header Pointer to the header of the block.
+ * @param requested The number of bytes requested, 0 for releases.
+ * @param delta The change to the number of live bytes.
+ * @param count Whether the operation counts as an allocation call.
  */
-int get_player_idx(pGame game, char* name) {
-    for (int i = 0; i < game->num_players; i++) {
-        if (strcmp(game->players[i]->name, name) == 0) {
-            return i;
-        }
+void mem_account_block(tMemHeader* header, size_t requested, long delta, bool count) {
+    tMemTracker* tracker = header->info.tracker;
+    mem_account(&tracker->total, requested, delta, count);
+    mem_account(&tracker->commands[header->info.command].stats, requested, delta, count);
+    if (header->info.site != -1) {
+        mem_account(&tracker->sites[header->info.site].stats, requested, delta, count);
     }
-    return -1;
 }
 
 /**
- * @brief Get the player object
+ * @brief Set the maximum number of live bytes of the current tracker.
  *
- * This function returns a pointer to a tPlayer structure, or NULL if the player
- * is not found.
+ * Batch sessions start their trackers with the limit of the process tracker,
+ * so the limit applies to each session on its own.
  *
- * @param game Pointer to a tGame structure.
- * @param name The name of the player.
- * @return pPlayer Pointer to a tPlayer structure, or NULL if not found.
+ * @param limit The maximum number of live bytes, 0 for no limit.
  */
-pPlayer get_player(pGame game, char* name) {
-    int idx = get_player_idx(game, name);
-    if (idx != -1) {
-        return game->players[idx];
-    }
-    return NULL;
+void mem_set_limit(long limit) {
+    tMemTracker* tracker = mem_current_tracker;
+    pthread_mutex_lock(&tracker->lock);
+    tracker->limit = limit;
+    pthread_mutex_unlock(&tracker->lock);
 }
 
 /**
- * @brief Check if a player exists in the game.
+ * @brief Get the maximum number of live bytes of the current tracker.
  *
- * @param game Pointer to a tGame structure.
- * @param name The name of the player.
- * @return true If the player exists.
- * @return false If the player does not exist.
+ * @return long The maximum number of live bytes, 0 for no limit.
  */
-bool has_player(pGame game, char* name) {
-    return get_player(game, name) != NULL;
+long mem_get_limit(void) {
+    tMemTracker* tracker = mem_current_tracker;
+    pthread_mutex_lock(&tracker->lock);
+    long limit = tracker->limit;
+    pthread_mutex_unlock(&tracker->lock);
+    return limit;
 }
 
 /**
- * @brief Add a player to the game.
+ * @brief Check whether an allocation fits in the memory limit of a tracker.
  *
- * This function adds a player to the game, allocating memory for the player,
- * increasing the memory for the players array, and appending the player to the
- * end of the array.
+ * Must be called with the lock of the tracker held.
  *
- * This function allocates memory for the player, and the player->name field. It
- * is the responsibility of the caller to free this memory.
+ * @param tracker Pointer to a tMemTracker structure.
+ * @param delta The change to the number of live bytes.
+ * @return true If there is no limit, or the allocation fits.
+ */
+bool mem_within_limit(tMemTracker* tracker, long delta) {
+    return tracker->limit == 0 || tracker->total.live_bytes + delta <= tracker->limit;
+}
+
+/**
+ * @brief Terminates the program when an allocation exceeds the memory limit.
  *
- * @param game Pointer to a tGame structure.
- * @param name The name of the player.
+ * Allocations are not checked for failure by their callers, so a failed
+ * allocation ends the program, as an exhausted malloc would. Must be called
+ * with the lock of the tracker held, which is released first.
+ *
+ * @param tracker Pointer to the tMemTracker of the allocation.
+ * @param size The number of bytes requested.
  */
-void add_player(pGame game, char* name) {
-    game->num_players++;
-    game->players = realloc(game->players, sizeof(pPlayer) * game->num_players);
-    game->players[game->num_players - 1] = malloc(sizeof(tPlayer));
-    game->players[game->num_players - 1]->name = malloc(sizeof(char) * (strlen(name) + 1));
-    strcpy(game->players[game->num_players - 1]->name, name);
-    game->players[game->num_players - 1]->games_played = 0;
-    game->players[game->num_players - 1]->wins = 0;
+void mem_limit_exceeded(tMemTracker* tracker, size_t size) {
+    long limit = tracker->limit;
+    pthread_mutex_unlock(&tracker->lock);
+    fprintf(stderr, "Limite de memória excedido (%zu bytes pedidos, limite %ld).\n", size, limit);
+    exit(EXIT_FAILURE);
 }
 
 /**
- * @brief Remove a player from the set of registered players.
+ * @brief Tracked malloc.
  *
- * This functions frees memory associated with the player, and removes the
- * player from the collection of registered players.
+ * The bytes are checked against the memory limit and reserved under the same
+ * hold of the tracker lock, so that concurrent allocations cannot exceed the limit
+ * together, and the reservation is released if malloc fails. Allocations that
+ * would exceed the limit fail (see mem_limit_exceeded).
  *
- * This function frees the memory associated with the player, and reallocates
- * memory for the players array. It is the responsibility of the caller to free
- * the array.
+ * Use the track_malloc macro instead, which fills in the call site.
  *
- * @param game Pointer to a tGame structure.
- * @param name The name of the player.
+ * @param size The number of bytes to allocate.
+ * @param function The function where the allocation is made.
+ * @return void* Pointer to the allocated block, or NULL.
  */
-void remove_player(pGame game, char* name) {
-    int idx = get_player_idx(game, name);
-    pPlayer player = game->players[idx];
-    size_t num_players_to_move = game->num_players - idx - 1;
-    if (num_players_to_move > 0) {
-        memmove(&game->players[idx], &game->players[idx + 1], sizeof(pPlayer) * num_players_to_move);
+void* track_malloc_at(size_t size, const char* function) {
+    tMemTracker* tracker = mem_current_tracker;
+    tMemHeader info;
+    info.info.size = size;
+    info.info.tracker = tracker;
+    info.info.command = mem_current_command;
+    pthread_mutex_lock(&tracker->lock);
+    if (!mem_within_limit(tracker, (long)size)) {
+        mem_limit_exceeded(tracker, size);
     }
-    free(player->name);
-    free(player);
-    game->num_players--;
-    game->players = realloc(game->players, sizeof(pPlayer) * game->num_players);
-    if (game->num_players == 0) {
-        game->players = NULL;
+    info.info.site = mem_site_idx(tracker, function);
+    mem_account_block(&info, size, (long)size, true);
+    pthread_mutex_unlock(&tracker->lock);
+    tMemHeader* header = malloc(sizeof(tMemHeader) + size);
+    if (header == NULL) {
+        pthread_mutex_lock(&tracker->lock);
+        mem_account_block(&info, 0, -(long)size, false);
+        pthread_mutex_unlock(&tracker->lock);
+        return NULL;
     }
+    header->info = info.info;
+    return header + 1;
 }
 
 /**
- * @brief Check if a player is in the current game.
+ * @brief Tracked free.
  *
- * @param game Pointer to a tGame structure.
- * @param name The name of the player.
- * @return true If the player is in the game.
- * @return false If the player is not in the game.
+ * @param ptr Pointer to a block allocated by the tracking allocator, or NULL.
  */
-bool player_in_game(pGame game, char* name) {
-    pPlayer player = get_player(game, name);
-    return game->player1->player == player || game->player2->player == player;
+void track_free(void* ptr) {
+    if (ptr == NULL) {
+        return;
+    }
+    tMemHeader* header = (tMemHeader*)ptr - 1;
+    tMemTracker* tracker = header->info.tracker;
+    pthread_mutex_lock(&tracker->lock);
+    mem_account_block(header, 0, -(long)header->info.size, false);
+    pthread_mutex_unlock(&tracker->lock);
+    free(header);
 }
 
 /**
- * @brief Check if the game has any registered players.
+ * @brief Tracked realloc.
  *
- * @param game Pointer to a tGame structure.
- * @return true If the game has any players.
- * @return false If the game has no players.
+ * The block is attributed to the instruction and call site of the realloc.
+ * A size of 0 releases the block and returns NULL. Growing a block beyond the
+ * memory limit fails, as in track_malloc_at.
+ *
+ * Use the track_realloc macro instead, which fills in the call site.
+ *
+ * @param ptr Pointer to a block allocated by the tracking allocator, or NULL.
+ * @param size The new number of bytes.
+ * @param function The function where the allocation is made.
+ * @return void* Pointer to the reallocated block, or NULL.
  */
-bool has_players(pGame game) {
-    return game->num_players > 0;
+void* track_realloc_at(void* ptr, size_t size, const char* function) {
+    if (ptr == NULL) {
+        return track_malloc_at(size, function);
+    }
+    if (size == 0) {
+        track_free(ptr);
+        return NULL;
+    }
+    tMemHeader* header = (tMemHeader*)ptr - 1;
+    tMemHeader old_header = *header;
+    tMemTracker* tracker = mem_current_tracker;
+    tMemTracker* old_tracker = old_header.info.tracker;
+    tMemHeader info;
+    info.info.size = size;
+    info.info.tracker = tracker;
+    info.info.command = mem_current_command;
+    // A block moves to the tracker of the realloc, which is almost always its own
+    long delta = old_tracker == tracker ? (long)size - (long)old_header.info.size : (long)size;
+    pthread_mutex_lock(&tracker->lock);
+    if (!mem_within_limit(tracker, delta)) {
+        mem_limit_exceeded(tracker, size);
+    }
+    if (old_tracker == tracker) {
+        mem_account_block(&old_header, 0, -(long)old_header.info.size, false);
+    }
+    info.info.site = mem_site_idx(tracker, function);
+    mem_account_block(&info, size, (long)size, true);
+    pthread_mutex_unlock(&tracker->lock);
+    if (old_tracker != tracker) {
+        pthread_mutex_lock(&old_tracker->lock);
+        mem_account_block(&old_header, 0, -(long)old_header.info.size, false);
+        pthread_mutex_unlock(&old_tracker->lock);
+    }
+    tMemHeader* new_header = realloc(header, sizeof(tMemHeader) + size);
+    if (new_header == NULL) {
+        // The old block is still allocated, and accounted as before
+        pthread_mutex_lock(&tracker->lock);
+        mem_account_block(&info, 0, -(long)size, false);
+        pthread_mutex_unlock(&tracker->lock);
+        pthread_mutex_lock(&old_tracker->lock);
+        mem_account_block(&old_header, 0, (long)old_header.info.size, false);
+        pthread_mutex_unlock(&old_tracker->lock);
+        return NULL;
+    }
+    new_header->info = info.info;
+    return new_header + 1;
 }
 
+#if MEM_TRACKING
+#define track_malloc(size) track_malloc_at((size), __func__)
+#define track_realloc(ptr, size) track_realloc_at((ptr), (size), __func__)
+#else
+#define track_malloc(size) malloc(size)
+#define track_realloc(ptr, size) realloc((ptr), (size))
+#define track_free(ptr) free(ptr)
+#endif
+
 /**
- * @brief Comparison function for sorting players by name.
+ * @brief Prints a summary of the allocations on the current tracker.
  *
- * @param p1 Pointer to a pointer to a tPlayer structure.
- * @param p2 Pointer to a pointer to a tPlayer structure.
- * @return int The result of the comparison between player names.
+ * Prints one line per instruction, one line per call site, and the totals, with
+ * the number of calls, the bytes requested, the live bytes and the peak of live
+ * bytes. Live bytes of finished instructions are blocks not yet released. The
+ * memory limit, if any, is printed last.
+ *
+ * @param out The output stream.
  */
-int comp_players(pPlayer* p1, pPlayer* p2) {
-    return strcmp((*p1)->name, (*p2)->name);
+void print_mem_stats(FILE* out) {
+    if (!MEM_TRACKING) {
+        fprintf(out, "Monitorização de memória desativada.\n");
+        return;
+    }
+    tMemTracker* tracker = mem_current_tracker;
+    pthread_mutex_lock(&tracker->lock);
+    fprintf(out, "Instrução Chamadas Bytes Vivos Pico\n");
+    for (int i = 0; i < tracker->num_commands; i++) {
+        tMemStats* stats = &tracker->commands[i].stats;
+        fprintf(out, "%s %ld %ld %ld %ld\n", tracker->commands[i].name, stats->calls, stats->bytes, stats->live_bytes, stats->peak_bytes);
+    }
+    fprintf(out, "Local Chamadas Bytes Vivos Pico\n");
+    for (int i = 0; i < tracker->num_sites; i++) {
+        tMemStats* stats = &tracker->sites[i].stats;
+        fprintf(out, "%s %ld %ld %ld %ld\n", tracker->sites[i].function, stats->calls, stats->bytes, stats->live_bytes, stats->peak_bytes);
+    }
+    tMemStats* stats = &tracker->total;
+    fprintf(out, "Total %ld %ld %ld %ld\n", stats->calls, stats->bytes, stats->live_bytes, stats->peak_bytes);
+    if (tracker->limit > 0) {
+        fprintf(out, "Limite %ld\n", tracker->limit);
+    }
+    pthread_mutex_unlock(&tracker->lock);
 }
 
 /**
- * @brief Check if there is a game in progress.
+ * @brief The player registry.
  *
- * @param game Pointer to a tGame structure.
- * @return true If there is a game in progress.
- * @return false If there is no game in progress.
+ * Registered players are stored as a structure of arrays, in registration
+ * order, so that scans over the registry read contiguous memory, and names are
+ * stored in a single arena. Each player also has an id, which does not change
+ * when other players are removed, and is used to refer to the player from
+ * games and rankings. The ids of removed players are reused by the next
+ * players added, so the ids stay below the peak number of players.
+ *
+ * Pointers into the arrays or the arena, such as the names returned by
+ * registry_name, are only valid until the next player is added or removed.
  */
-bool in_game(pGame game) {
-    return game->board != NULL;
-}
+typedef struct {
+    int num_players;        ///< The number of registered players.
+    int capacity;           ///< The number of players the arrays can hold.
+    int* ids;               ///< The id of each player.
+    int* games_played;      ///< The number of games played by each player.
+    int* wins;              ///< The number of games won by each player.
+    size_t* name_offsets;   ///< Offset of the name of each player in names.
+    char* names;            ///< Arena of null-terminated names.
+    size_t names_size;      ///< The number of bytes used in names, including removed names.
+    size_t names_capacity;  ///< The number of bytes allocated for names.
+    size_t names_garbage;   ///< The number of bytes of removed names in names.
+    int* index;             ///< Index of each id in the arrays, -1 for removed players.
+    int num_ids;            ///< The number of ids assigned so far.
+    int ids_capacity;       ///< The number of ids index and free_ids can hold.
+    int* free_ids;          ///< Ids of removed players, to be reused.
+    int num_free_ids;       ///< The number of ids in free_ids.
+} tRegistry, *pRegistry;
 
 /**
- * @brief Check if the given dimensions are valid.
+ * @brief Get the name of a registered player.
  *
- * The dimensions are valid if the height is greater than or equal to half of the width.
+ * The name lives in the arena, so it is only valid until the next player is
+ * added or removed.
  *
- * @param width The width of the board.
- * @param height The height of the board.
- * @return true If the dimensions are valid.
- * @return false If the dimensions are not valid.
+ * @param registry Pointer to a tRegistry structure.
+ * @param id The id of the player.
+ * @return char* The name of the player.
  */
-bool valid_dimensions(int width, int height) {
-    return height >= width / 2;
+char* registry_name(const tRegistry* registry, int id) {
+    return registry->names + registry->name_offsets[registry->index[id]];
 }
 
 /**
- * @brief Check if the given winning sequence size is valid.
- *
- * The sequence size is valid if it is less than the width of the board.
+ * @brief Find a registered player by name.
  *
- * @param width The width of the board.
- * @param sequence_size The size of the sequence.
- * @return true If the sequence size is valid.
- * @return false If the sequence size is not valid.
+ * @param registry Pointer to a tRegistry structure.
+ * @param name The name of the player.
+ * @return int The index of the player in the arrays, or -1 if not found.
  */
-bool valid_sequence(int width, int sequence_size) {
-    return width > sequence_size;
+int registry_find(const tRegistry* registry, const char* name) {
+    for (int i = 0; i < registry->num_players; i++) {
+        if (strcmp(registry->names + registry->name_offsets[i], name) == 0) {
+            return i;
+        }
+    }
+    return -1;
 }
 
 /**
- * @brief Check if the given special sequences are valid.
+ * @brief Append a name to the arena of a registry.
  *
- * The special sequences are valid if they are less than the winning sequence size.
- *
- * @param sequence_size The size of the winning sequence.
- * @param special_sequences Array of special sequence sizes.
- * @param num_special_sequences The number of special sequence sizes.
- * @return true If the special sequence sizes are valid.
- * @return false If the special sequence sizes are not valid.
+ * @param registry Pointer to a tRegistry structure.
+ * @param name The name.
+ * @return size_t The offset of the name in the arena.
  */
-bool valid_special_sequences(int sequence_size, int* special_sequences, int num_special_sequences) {
-    for (int i = 0; i < num_special_sequences; i++) {
-        if (special_sequences[i] >= sequence_size) {
-            return false;
-        }
+size_t registry_put_name(pRegistry registry, const char* name) {
+    size_t length = strlen(name) + 1;
+    if (registry->names_size + length > registry->names_capacity) {
+        registry->names_capacity = registry->names_capacity * 2 > registry->names_size + length ? registry->names_capacity * 2 : registry->names_size + length + 256;
+        registry->names = track_realloc(registry->names, registry->names_capacity);
     }
-    return true;
+    memcpy(registry->names + registry->names_size, name, length);
+    registry->names_size += length;
+    return registry->names_size - length;
 }
 
 /**
- * @brief Allocate memory for, and initialize, a new tInGamePlayer structure.
- *
- * This function allocates memory for a new tInGamePlayer structure, and
- * initializes it. It returns a pointer to the new structure in the player
- * parameter.
+ * @brief Register a player, with no games played.
  *
- * This function allocates memory for the special sequences array, and is the
- * responsibility of the caller to free it.
+ * The arrays double their capacity when full. The player gets the id of the
+ * last removed player, if any, or a new id.
  *
- * @param game Pointer to a tGame structure.
- * @param[out] player Pointer to a pInGamePlayer structure pointer.  It will be
- * set to point to the new tInGamePlayer structure.
+ * @param registry Pointer to a tRegistry structure.
  * @param name The name of the player.
- * @param special_sequences Array of special sequence sizes.
- * @param num_special_sequences The number of special sequence sizes.
+ * @return int The id of the player.
  */
-void start_game_player(pGame game, pInGamePlayer* player, char* name, int* special_sequences, int num_special_sequences) {
-    (*player) = malloc(sizeof(tInGamePlayer));
-    (*player)->player = get_player(game, name);
-    (*player)->special_sequences = malloc(sizeof(int) * num_special_sequences);
-    memcpy((*player)->special_sequences, special_sequences, sizeof(int) * num_special_sequences);
-    (*player)->num_special_sequences = num_special_sequences;
+int registry_add(pRegistry registry, const char* name) {
+    if (registry->num_players == registry->capacity) {
+        registry->capacity = registry->capacity == 0 ? 8 : registry->capacity * 2;
+        registry->ids = track_realloc(registry->ids, sizeof(int) * registry->capacity);
+        registry->games_played = track_realloc(registry->games_played, sizeof(int) * registry->capacity);
+        registry->wins = track_realloc(registry->wins, sizeof(int) * registry->capacity);
+        registry->name_offsets = track_realloc(registry->name_offsets, sizeof(size_t) * registry->capacity);
+    }
+    if (registry->num_free_ids == 0 && registry->num_ids == registry->ids_capacity) {
+        registry->ids_capacity = registry->ids_capacity == 0 ? 8 : registry->ids_capacity * 2;
+        registry->index = track_realloc(registry->index, sizeof(int) * registry->ids_capacity);
+        registry->free_ids = track_realloc(registry->free_ids, sizeof(int) * registry->ids_capacity);
+    }
+    int idx = registry->num_players++;
+    int id = registry->num_free_ids > 0 ? registry->free_ids[--registry->num_free_ids] : registry->num_ids++;
+    registry->ids[idx] = id;
+    registry->index[id] = idx;
+    registry->games_played[idx] = 0;
+    registry->wins[idx] = 0;
+    registry->name_offsets[idx] = registry_put_name(registry, name);
+    return id;
 }
 
 /**
- * @brief Start a new game.
+ * @brief Remove a player from a registry.
  *
- * This function starts a new game. It initializes the players, the board, and
- * the winning sequence size.
- *
- * This function allocates memory for the board, and for the special sequences
- * of the players. It is the responsibility of the caller to free this memory.
+ * The name stays in the arena until removed names take more than half of it,
+ * and the arena is then rewritten with the remaining names. The id of the
+ * player is kept for reuse.
  *
- * @param game Pointer to a tGame structure.
- * @param player1_name The name of the first player.
- * @param player2_name The name of the second player.
- * @param width The width of the board.
- * @param height The height of the board.
- * @param sequence_size The size of the winning sequence.
- * @param special_sequences Array of special sequence sizes.
- * @param num_special_sequences The number of special sequence sizes.
+ * @param registry Pointer to a tRegistry structure.
+ * @param idx The index of the player in the arrays.
  */
-void start_game(pGame game, char* player1_name, char* player2_name, int width, int height, int sequence_size, int* special_sequences, int num_special_sequences) {
-    start_game_player(game, &(game->player1), player1_name, special_sequences, num_special_sequences);
-    start_game_player(game, &(game->player2), player2_name, special_sequences, num_special_sequences);
-    game->sequence_size = sequence_size;
-    game->special_sequences = malloc(sizeof(int) * num_special_sequences);
-    memcpy(game->special_sequences, special_sequences, sizeof(int) * num_special_sequences);
-    game->num_special_sequences = num_special_sequences;
-    game->width = width;
-    game->height = height;
-    game->board = malloc(sizeof(pInGamePlayer*) * game->height);
-    for (int r = 0; r < game->height; r++) {
-        game->board[r] = malloc(sizeof(pInGamePlayer) * game->width);
-        for (int c = 0; c < game->width; c++) {
-            game->board[r][c] = NULL;
+void registry_remove(pRegistry registry, int idx) {
+    registry->names_garbage += strlen(registry->names + registry->name_offsets[idx]) + 1;
+    registry->index[registry->ids[idx]] = -1;
+    registry->free_ids[registry->num_free_ids++] = registry->ids[idx];
+    int num_to_move = registry->num_players - idx - 1;
+    memmove(&registry->ids[idx], &registry->ids[idx + 1], sizeof(int) * num_to_move);
+    memmove(&registry->games_played[idx], &registry->games_played[idx + 1], sizeof(int) * num_to_move);
+    memmove(&registry->wins[idx], &registry->wins[idx + 1], sizeof(int) * num_to_move);
+    memmove(&registry->name_offsets[idx], &registry->name_offsets[idx + 1], sizeof(size_t) * num_to_move);
+    registry->num_players--;
+    for (int i = idx; i < registry->num_players; i++) {
+        registry->index[registry->ids[i]] = i;
+    }
+    if (registry->names_garbage > registry->names_size / 2) {
+        char* names = registry->names;
+        registry->names = NULL;
+        registry->names_size = 0;
+        registry->names_capacity = 0;
+        registry->names_garbage = 0;
+        for (int i = 0; i < registry->num_players; i++) {
+            registry->name_offsets[i] = registry_put_name(registry, names + registry->name_offsets[i]);
         }
+        track_free(names);
     }
 }
 
 /**
- * @brief Build an array of unique special sequences from the current game.
- *
- * This function builds an array of unique special sequences from the current
- * game. It returns a pointer to the array, and sets the
- * num_unique_special_sequences parameter to the number of unique special
- * sequences.
+ * @brief Frees the arrays of a registry.
  *
- * This function allocates memory for the array. It is the responsibility of the
- * caller to free the memory.
+ * @param registry Pointer to a tRegistry structure.
+ */
+void free_registry(pRegistry registry) {
+    track_free(registry->ids);
+    track_free(registry->games_played);
+    track_free(registry->wins);
+    track_free(registry->name_offsets);
+    track_free(registry->names);
+    track_free(registry->index);
+    track_free(registry->free_ids);
+    *registry = (tRegistry){0};
+}
+
+typedef struct tBot tBot;
+
+/**
+ * @brief The in-game player structure.
  *
- * @param game Pointer to a tGame structure.
- * @param num_unique_special_sequences Pointer to an int. It will be set to the
- * number of unique special sequences.
- * @return int* Pointer to an array of unique special sequences.
+ * This structure contains all the information about a player in a game.
  */
-int* get_unique_special_sequences(pGame game, int* num_unique_special_sequences) {
-    int* unique_special_sequences = NULL;
-    *num_unique_special_sequences = 0;
-    for (int i = 0; i < game->num_special_sequences; i++) {
+typedef struct {
+    int player;                 ///< The id of the registered player.
+    int* special_sequences;     ///< Array of special sequences.
+    int num_special_sequences;  ///< The number of special sequences.
+    tBot* bot;                  ///< The bot playing for the player, or NULL.
+} tInGamePlayer, *pInGamePlayer;
+
+/**
+ * @brief A node of a ranking tree.
+ *
+ * Rankings are treaps (binary search trees with random heap priorities), where
+ * each node records the size of its subtree, to compute positions in
+ * logarithmic time.
+ */
+typedef struct tRankNode {
+    int player;               ///< The id of the ranked player.
+    int priority;             ///< Random heap priority.
+    int size;                 ///< The number of nodes in this subtree.
+    int games;                ///< The games played by the player when it was inserted.
+    int max_games;            ///< The maximum games in this subtree.
+    struct tRankNode* left;   ///< Players ranked before this one.
+    struct tRankNode* right;  ///< Players ranked after this one.
+} tRankNode, *pRankNode;
+
+/**
+ * @brief The ranking structure.
+ *
+ * A ranking keeps the registered players ordered by a comparison function.
+ * Since the order depends on the player records, a player must be removed from
+ * the ranking before its records change, and inserted again afterwards.
+ *
+ * Nodes are allocated in blocks, and removed nodes are kept in a free list to
+ * be reused by later insertions.
+ */
+typedef struct {
+    pRankNode root;                     ///< The root of the tree.
+    int (*compare)(const tRegistry*, int, int);  ///< Ranking order of two ids, negative if the first player ranks higher.
+    const tRegistry* registry;          ///< The registry of the ranked players.
+    pRankNode free_nodes;               ///< Free list of nodes, linked by the right field.
+    pRankNode* blocks;                  ///< Array of allocated node blocks.
+    int num_blocks;                     ///< The number of allocated node blocks.
+    int num_nodes;                      ///< The number of nodes in all blocks.
+} tRanking, *pRanking;
+
+#define CHANGES_CAPACITY 1024  ///< The number of board changes kept for delta views.
+
+/**
+ * @brief A change to a board position.
+ */
+typedef struct {
+    long version;  ///< The board version that introduced the change.
+    int line;      ///< The line of the changed position.
+    int column;    ///< The column of the changed position.
+} tCellChange;
+
+#define ENGINE_MAX_WIDTH 32   ///< Maximum width of a specialized engine (bits of a row mask).
+#define ENGINE_MAX_HEIGHT 16  ///< Maximum height of a specialized engine.
+
+/**
+ * @brief State of the specialized engines.
+ *
+ * Mirrors the board as one bit mask per line and player, where bit c is set if
+ * the player has a piece in column c, and keeps the first occupied line of each
+ * column. Only maintained while a specialized engine is selected.
+ */
+typedef struct {
+    uint32_t pieces[2][ENGINE_MAX_HEIGHT];  ///< Row masks of the first and second players.
+    int top[ENGINE_MAX_WIDTH];              ///< First occupied line of each column, height if empty.
+} tEngineState;
+
+typedef struct tEngine tEngine;
+typedef struct tArchive tArchive;
+
+/**
+ * @brief A growable array of bytes.
+ */
+typedef struct {
+    uint8_t* data;    ///< The bytes, or NULL if none were ever added.
+    size_t size;      ///< The number of bytes used.
+    size_t capacity;  ///< The number of bytes allocated.
+} tByteBuffer, *pByteBuffer;
+
+/**
+ * @brief Append bytes to a buffer.
+ *
+ * @param buffer Pointer to a tByteBuffer structure.
+ * @param bytes The bytes to append.
+ * @param count The number of bytes.
+ */
+void buffer_put_bytes(pByteBuffer buffer, const void* bytes, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    if (buffer->size + count > buffer->capacity) {
+        buffer->capacity = buffer->capacity * 2 > buffer->size + count ? buffer->capacity * 2 : buffer->size + count + 64;
+        buffer->data = track_realloc(buffer->data, buffer->capacity);
+    }
+    memcpy(buffer->data + buffer->size, bytes, count);
+    buffer->size += count;
+}
+
+/**
+ * @brief Append an unsigned integer to a buffer, as a variable-length integer.
+ *
+ * Each byte holds 7 bits, the least significant first, and the high bit is
+ * set in all bytes but the last. Small values take a single byte.
+ *
+ * @param buffer Pointer to a tByteBuffer structure.
+ * @param value The value to append.
+ */
+void buffer_put_varint(pByteBuffer buffer, uint64_t value) {
+    uint8_t bytes[10];
+    int count = 0;
+    do {
+        bytes[count++] = (value & 0x7F) | (value >= 0x80 ? 0x80 : 0);
+        value >>= 7;
+    } while (value != 0);
+    buffer_put_bytes(buffer, bytes, count);
+}
+
+/**
+ * @brief Read a variable-length integer written by buffer_put_varint.
+ *
+ * @param[in,out] p Pointer to the position to read, advanced past the integer.
+ * @return uint64_t The value read.
+ */
+uint64_t read_varint(const uint8_t** p) {
+    uint64_t value = 0;
+    int shift = 0;
+    uint8_t byte;
+    do {
+        byte = *(*p)++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        shift += 7;
+    } while ((byte & 0x80) && shift < 64);
+    return value;
+}
+
+/**
+ * @brief Free the bytes of a buffer, leaving it empty.
+ *
+ * @param buffer Pointer to a tByteBuffer structure.
+ */
+void buffer_free(pByteBuffer buffer) {
+    track_free(buffer->data);
+    *buffer = (tByteBuffer){NULL, 0, 0};
+}
+
+/**
+ * @brief The game structure.
+ *
+ * This structure contains all the information about the game.
+ */
+typedef struct {
+    tRegistry registry;         ///< The registered players.
+    int width;                  ///< The width of the board.
+    int height;                 ///< The height of the board.
+    int sequence_size;          ///< The size of the winning sequence.
+    int* special_sequences;     ///< Array of special sequences.
+    int num_special_sequences;  ///< The number of special sequences.
+    pInGamePlayer player1;      ///< Pointer to the first player.
+    pInGamePlayer player2;      ///< Pointer to the second player.
+    pInGamePlayer** board;      ///< The board, with dimensions height x width.
+    const tEngine* engine;      ///< The engine of the current game.
+    bool reference;             ///< Whether the game always uses the generic engine, as a reference.
+    tEngineState engine_state;  ///< State of the specialized engines.
+    long version;               ///< The board version, increased by every change to the board.
+    long dropped_version;       ///< Changes up to this version are no longer in the changes buffer.
+    tCellChange changes[CHANGES_CAPACITY];  ///< Ring buffer of the latest board changes.
+    int changes_start;          ///< Index of the oldest change in the ring buffer.
+    int num_changes;            ///< The number of changes in the ring buffer.
+    tRanking wins_ranking;      ///< Registered players ordered by wins.
+    tRanking rate_ranking;      ///< Registered players ordered by win rate.
+    uint8_t* windows;           ///< Pieces in each window of sequence_size cells, one bit per player.
+    int open_windows[2];        ///< Windows without pieces of the other player, for each player.
+    int empty_cells;            ///< The number of empty cells of the board.
+    tByteBuffer move_log;       ///< Moves of the current game, encoded for the archive.
+    int num_moves;              ///< The number of moves in move_log.
+    tArchive* archive;          ///< Archive of finished games, or NULL.
+} tGame, *pGame;
+
+/**
+ * @brief Comparison function for ranking players by wins.
+ *
+ * Players with more wins rank higher. Ties are ordered by name.
+ *
+ * @param registry Pointer to a tRegistry structure.
+ * @param id1 The id of the first player.
+ * @param id2 The id of the second player.
+ * @return int Negative if the first player ranks higher, positive if the second
+ * player ranks higher.
+ */
+int comp_wins(const tRegistry* registry, int id1, int id2) {
+    int idx1 = registry->index[id1];
+    int idx2 = registry->index[id2];
+    if (registry->wins[idx1] != registry->wins[idx2]) {
+        return registry->wins[idx1] > registry->wins[idx2] ? -1 : 1;
+    }
+    return strcmp(registry->names + registry->name_offsets[idx1], registry->names + registry->name_offsets[idx2]);
+}
+
+/**
+ * @brief Comparison function for ranking players by win rate.
+ *
+ * Players with a higher wins / games_played ratio rank higher. Players without
+ * games have a win rate of 0. Ties are ordered by wins, and then by name.
+ *
+ * @param registry Pointer to a tRegistry structure.
+ * @param id1 The id of the first player.
+ * @param id2 The id of the second player.
+ * @return int Negative if the first player ranks higher, positive if the second
+ * player ranks higher.
+ */
+int comp_win_rate(const tRegistry* registry, int id1, int id2) {
+    int idx1 = registry->index[id1];
+    int idx2 = registry->index[id2];
+    int games1 = registry->games_played[idx1] > 0 ? registry->games_played[idx1] : 1;
+    int games2 = registry->games_played[idx2] > 0 ? registry->games_played[idx2] : 1;
+    // Compare the fractions without dividing: w1/g1 > w2/g2 <=> w1*g2 > w2*g1
+    long long rate1 = (long long)registry->wins[idx1] * games2;
+    long long rate2 = (long long)registry->wins[idx2] * games1;
+    if (rate1 != rate2) {
+        return rate1 > rate2 ? -1 : 1;
+    }
+    return comp_wins(registry, id1, id2);
+}
+
+static _Thread_local const tRegistry* sort_registry;  ///< Registry of the ids sorted by the qsort adapters.
+
+/**
+ * @brief qsort adapter for comp_wins, on the ids of sort_registry.
+ *
+ * @param p1 Pointer to a player id.
+ * @param p2 Pointer to a player id.
+ * @return int The result of comp_wins.
+ */
+int comp_wins_qsort(const void* p1, const void* p2) {
+    return comp_wins(sort_registry, *(const int*)p1, *(const int*)p2);
+}
+
+/**
+ * @brief qsort adapter for comp_win_rate, on the ids of sort_registry.
+ *
+ * @param p1 Pointer to a player id.
+ * @param p2 Pointer to a player id.
+ * @return int The result of comp_win_rate.
+ */
+int comp_win_rate_qsort(const void* p1, const void* p2) {
+    return comp_win_rate(sort_registry, *(const int*)p1, *(const int*)p2);
+}
+
+/**
+ * @brief Get the size of a ranking subtree.
+ *
+ * @param node Pointer to a tRankNode structure, or NULL.
+ * @return int The number of nodes in the subtree.
+ */
+int rank_node_size(pRankNode node) {
+    return node == NULL ? 0 : node->size;
+}
+
+/**
+ * @brief Get the maximum games played in a ranking subtree.
+ *
+ * @param node Pointer to a tRankNode structure, or NULL.
+ * @return int The maximum games of the subtree, -1 if it is empty.
+ */
+int rank_node_max_games(pRankNode node) {
+    return node == NULL ? -1 : node->max_games;
+}
+
+/**
+ * @brief Recompute the size and maximum games of a node from its children.
+ *
+ * @param node Pointer to a tRankNode structure.
+ */
+void rank_node_update(pRankNode node) {
+    node->size = 1 + rank_node_size(node->left) + rank_node_size(node->right);
+    node->max_games = node->games;
+    if (rank_node_max_games(node->left) > node->max_games) node->max_games = rank_node_max_games(node->left);
+    if (rank_node_max_games(node->right) > node->max_games) node->max_games = rank_node_max_games(node->right);
+}
+
+/**
+ * @brief Split a ranking subtree.
+ *
+ * Splits the subtree in the players ranked before the given player, and the
+ * remaining players.
+ *
+ * @param ranking Pointer to a tRanking structure.
+ * @param node The root of the subtree.
+ * @param player The id of the player.
+ * @param[out] before The players ranked before the given player.
+ * @param[out] after The remaining players.
+ */
+void rank_split(pRanking ranking, pRankNode node, int player, pRankNode* before, pRankNode* after) {
+    if (node == NULL) {
+        *before = NULL;
+        *after = NULL;
+    } else if (ranking->compare(ranking->registry, node->player, player) < 0) {
+        rank_split(ranking, node->right, player, &node->right, after);
+        *before = node;
+        rank_node_update(node);
+    } else {
+        rank_split(ranking, node->left, player, before, &node->left);
+        *after = node;
+        rank_node_update(node);
+    }
+}
+
+/**
+ * @brief Merge two ranking subtrees.
+ *
+ * All players in the first subtree must rank before the players in the second.
+ *
+ * @param first The root of the first subtree.
+ * @param second The root of the second subtree.
+ * @return pRankNode The root of the merged subtree.
+ */
+pRankNode rank_merge(pRankNode first, pRankNode second) {
+    if (first == NULL) return second;
+    if (second == NULL) return first;
+    if (first->priority > second->priority) {
+        first->right = rank_merge(first->right, second);
+        rank_node_update(first);
+        return first;
+    }
+    second->left = rank_merge(first, second->left);
+    rank_node_update(second);
+    return second;
+}
+
+/**
+ * @brief Add a block of nodes to the free list of a ranking.
+ *
+ * @param ranking Pointer to a tRanking structure.
+ * @param size The number of nodes in the block.
+ */
+void rank_add_block(pRanking ranking, int size) {
+    pRankNode block = track_malloc(sizeof(tRankNode) * size);
+    ranking->num_blocks++;
+    ranking->blocks = track_realloc(ranking->blocks, sizeof(pRankNode) * ranking->num_blocks);
+    ranking->blocks[ranking->num_blocks - 1] = block;
+    ranking->num_nodes += size;
+    for (int i = size - 1; i >= 0; i--) {
+        block[i].right = ranking->free_nodes;
+        ranking->free_nodes = &block[i];
+    }
+}
+
+/**
+ * @brief Take nodes from the free list of a ranking.
+ *
+ * If the free list does not hold enough nodes, a new block is allocated, with
+ * at least as many nodes as the ranking already has. The nodes are returned as
+ * a list, linked by the right field.
+ *
+ * @param ranking Pointer to a tRanking structure.
+ * @param count The number of nodes.
+ * @return pRankNode The first node of the list.
+ */
+pRankNode rank_node_alloc(pRanking ranking, int count) {
+    int available = 0;
+    for (pRankNode node = ranking->free_nodes; node != NULL && available < count; node = node->right) {
+        available++;
+    }
+    if (available < count) {
+        int size = count - available;
+        if (size < ranking->num_nodes) size = ranking->num_nodes;
+        if (size < 64) size = 64;
+        rank_add_block(ranking, size);
+    }
+    pRankNode first = ranking->free_nodes;
+    pRankNode last = first;
+    for (int i = 1; i < count; i++) {
+        last = last->right;
+    }
+    ranking->free_nodes = last->right;
+    last->right = NULL;
+    return first;
+}
+
+/**
+ * @brief Insert a player in a ranking.
+ *
+ * Nodes are taken from the ranking blocks, which are released by free_ranking.
+ *
+ * @param ranking Pointer to a tRanking structure.
+ * @param player The id of the player.
+ */
+void ranking_insert(pRanking ranking, int player) {
+    pRankNode node = rank_node_alloc(ranking, 1);
+    node->player = player;
+    node->priority = rand();
+    node->games = ranking->registry->games_played[ranking->registry->index[player]];
+    node->left = NULL;
+    node->right = NULL;
+    rank_node_update(node);
+    pRankNode before;
+    pRankNode after;
+    rank_split(ranking, ranking->root, player, &before, &after);
+    ranking->root = rank_merge(rank_merge(before, node), after);
+}
+
+/**
+ * @brief Remove a player from a ranking subtree.
+ *
+ * @param ranking Pointer to a tRanking structure.
+ * @param node The root of the subtree.
+ * @param player The id of the player.
+ * @return pRankNode The new root of the subtree.
+ */
+pRankNode rank_remove(pRanking ranking, pRankNode node, int player) {
+    if (node == NULL) {
+        return NULL;
+    }
+    if (node->player == player) {
+        pRankNode merged = rank_merge(node->left, node->right);
+        node->right = ranking->free_nodes;
+        ranking->free_nodes = node;
+        return merged;
+    }
+    if (ranking->compare(ranking->registry, player, node->player) < 0) {
+        node->left = rank_remove(ranking, node->left, player);
+    } else {
+        node->right = rank_remove(ranking, node->right, player);
+    }
+    rank_node_update(node);
+    return node;
+}
+
+/**
+ * @brief Remove a player from a ranking.
+ *
+ * The player records must be the same as when the player was inserted.
+ *
+ * @param ranking Pointer to a tRanking structure.
+ * @param player The id of the player.
+ */
+void ranking_remove(pRanking ranking, int player) {
+    ranking->root = rank_remove(ranking, ranking->root, player);
+}
+
+/**
+ * @brief Get the position of a player in a ranking.
+ *
+ * @param ranking Pointer to a tRanking structure.
+ * @param player The id of a ranked player.
+ * @return int The position of the player, starting at 1.
+ */
+int ranking_position(pRanking ranking, int player) {
+    int position = 1;
+    pRankNode node = ranking->root;
+    while (node != NULL && node->player != player) {
+        if (ranking->compare(ranking->registry, player, node->player) < 0) {
+            node = node->left;
+        } else {
+            position += rank_node_size(node->left) + 1;
+            node = node->right;
+        }
+    }
+    return position + rank_node_size(node == NULL ? NULL : node->left);
+}
+
+/**
+ * @brief Compute the subtree sizes and maximum games of a ranking subtree.
+ *
+ * @param node The root of the subtree.
+ */
+void rank_fix_sizes(pRankNode node) {
+    if (node == NULL) {
+        return;
+    }
+    rank_fix_sizes(node->left);
+    rank_fix_sizes(node->right);
+    rank_node_update(node);
+}
+
+/**
+ * @brief Build an empty ranking from an array of players.
+ *
+ * Sorts a copy of the array by the ranking order, and builds the treap in a
+ * single pass over the sorted players, keeping the rightmost path of the tree
+ * in a stack. All nodes are taken from a single block.
+ *
+ * @param ranking Pointer to an empty tRanking structure.
+ * @param players Array of player ids.
+ * @param num_players The number of players.
+ */
+void ranking_build(pRanking ranking, const int* players, int num_players) {
+    if (num_players == 0) {
+        return;
+    }
+    int* sorted = track_malloc(sizeof(int) * num_players);
+    memcpy(sorted, players, sizeof(int) * num_players);
+    sort_registry = ranking->registry;
+    qsort(sorted, num_players, sizeof(int), ranking->compare == comp_wins ? comp_wins_qsort : comp_win_rate_qsort);
+    pRankNode* spine = track_malloc(sizeof(pRankNode) * num_players);
+    int spine_size = 0;
+    pRankNode node = rank_node_alloc(ranking, num_players);
+    for (int i = 0; i < num_players; i++) {
+        pRankNode next = node->right;
+        node->player = sorted[i];
+        node->priority = rand();
+        node->games = ranking->registry->games_played[ranking->registry->index[sorted[i]]];
+        node->right = NULL;
+        node->left = NULL;
+        pRankNode last = NULL;
+        while (spine_size > 0 && spine[spine_size - 1]->priority < node->priority) {
+            last = spine[--spine_size];
+        }
+        node->left = last;
+        if (spine_size > 0) {
+            spine[spine_size - 1]->right = node;
+        }
+        spine[spine_size++] = node;
+        node = next;
+    }
+    ranking->root = spine[0];
+    rank_fix_sizes(ranking->root);
+    track_free(spine);
+    track_free(sorted);
+}
+
+/**
+ * @brief Frees the nodes of a ranking.
+ *
+ * @param ranking Pointer to a tRanking structure.
+ */
+void free_ranking(pRanking ranking) {
+    for (int i = 0; i < ranking->num_blocks; i++) {
+        track_free(ranking->blocks[i]);
+    }
+    track_free(ranking->blocks);
+    ranking->blocks = NULL;
+    ranking->num_blocks = 0;
+    ranking->num_nodes = 0;
+    ranking->free_nodes = NULL;
+    ranking->root = NULL;
+}
+
+/**
+ * @brief Insert a player in all rankings of the game.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param player The id of the player.
+ */
+void rankings_insert(pGame game, int player) {
+    ranking_insert(&game->wins_ranking, player);
+    ranking_insert(&game->rate_ranking, player);
+}
+
+/**
+ * @brief Remove a player from all rankings of the game.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param player The id of the player.
+ */
+void rankings_remove(pGame game, int player) {
+    ranking_remove(&game->wins_ranking, player);
+    ranking_remove(&game->rate_ranking, player);
+}
+
+/**
+ * @brief Prints the players of a ranking subtree, in ranking order.
+ *
+ * Only players with at least min_games games played are printed, up to the
+ * number of players given by remaining. The traversal stops once remaining
+ * reaches 0, and skips subtrees whose maximum games is below min_games, so
+ * it visits O((K + 1) log n) nodes to print K players.
+ *
+ * @param out The output stream.
+ * @param registry Pointer to the tRegistry of the ranked players.
+ * @param node The root of the subtree.
+ * @param min_games The minimum number of games played.
+ * @param[in,out] remaining The number of players still to print.
+ */
+void print_rank_nodes(FILE* out, const tRegistry* registry, pRankNode node, int min_games, int* remaining) {
+    if (node == NULL || *remaining <= 0 || node->max_games < min_games) {
+        return;
+    }
+    print_rank_nodes(out, registry, node->left, min_games, remaining);
+    int idx = registry->index[node->player];
+    if (*remaining > 0 && registry->games_played[idx] >= min_games) {
+        fprintf(out, "%s %d %d\n", registry_name(registry, node->player), registry->games_played[idx], registry->wins[idx]);
+        (*remaining)--;
+    }
+    print_rank_nodes(out, registry, node->right, min_games, remaining);
+}
+
+/**
+ * @brief A published player record.
+ */
+typedef struct {
+    char* name;        ///< Copy of the name of the player.
+    int games_played;  ///< The number of games played by the player.
+    int wins;          ///< The number of games won by the player.
+} tPlayerRecord;
+
+/**
+ * @brief Published copy of the registered players.
+ *
+ * Records are kept in the same order as the registry of the game. The
+ * records array never grows in place: a full view is replaced by a new one.
+ */
+typedef struct {
+    tPlayerRecord* records;  ///< Array of player records.
+    int num_players;         ///< The number of player records.
+    int capacity;            ///< The number of records the array can hold.
+} tRegistryView, *pRegistryView;
+
+/**
+ * @brief Published copy of the game in progress.
+ */
+typedef struct {
+    int width;        ///< The width of the board.
+    int height;       ///< The height of the board.
+    char* names[2];   ///< Copies of the names of the first and second players.
+    int num_sizes;    ///< The number of unique special sequence sizes.
+    int* sizes;       ///< Unique special sequence sizes of the game.
+    int* counts;      ///< Available special sequences, num_sizes per player.
+    uint8_t* cells;   ///< The board, 0 for empty, or 1 and 2 for the players.
+} tBoardView, *pBoardView;
+
+/**
+ * @brief A block waiting to be released.
+ */
+typedef struct {
+    void* ptr;                ///< The block.
+    void (*release)(void*);  ///< The function that releases the block.
+    uint64_t epoch;           ///< The publication epoch in which the block was retired.
+} tRetired;
+
+#define SPECTATORS_MAX 64  ///< Maximum number of spectator threads.
+
+/**
+ * @brief The files of a spectator.
+ */
+typedef struct {
+    pthread_t thread;  ///< The spectator thread.
+    FILE* in;          ///< The spectator instructions.
+    FILE* out;         ///< The spectator output.
+    char* buffer;      ///< The output kept in memory, or NULL if written to a file.
+    size_t size;       ///< The number of bytes in buffer.
+    int slot;          ///< The index of the spectator.
+} tSpectator, *pSpectator;
+
+/**
+ * @brief State published for spectator threads.
+ *
+ * Spectators answer LJ, DJ and VR from copies of the game state, so that the
+ * main thread never waits for them. Changes made in place are protected by a
+ * sequence lock: the main thread makes seq odd while writing, and readers
+ * retry if seq was odd or changed while they copied. Whole views are replaced
+ * by swapping pointers, and replaced blocks are retired.
+ *
+ * Retired blocks are released by epochs: each block is tagged with the epoch
+ * in which it was unlinked, and the epoch then advances. Each reader records
+ * the epoch in which it started reading, so a block is released once every
+ * active reader started in a later epoch, even if readers never all leave at
+ * once.
+ */
+typedef struct {
+    bool enabled;                    ///< Whether the state is being published.
+    atomic_uint seq;                 ///< Sequence lock of in place changes.
+    _Atomic(pRegistryView) registry; ///< The published players.
+    _Atomic(pBoardView) board;       ///< The published game, or NULL.
+    _Atomic(uint64_t) epoch;         ///< The current publication epoch.
+    _Atomic(uint64_t) reader_epochs[SPECTATORS_MAX];  ///< The epoch each spectator started reading in, plus 1, or 0.
+    tRetired* retired;               ///< Blocks waiting to be released.
+    int num_retired;                 ///< The number of retired blocks.
+    pSpectator* spectators;          ///< Spectators, released by stop_spectators.
+    int num_spectators;              ///< The number of spectator threads.
+} tPublication;
+
+static tPublication publication;
+
+/**
+ * @brief Release a block allocated with track_malloc.
+ *
+ * @param ptr Pointer to the block.
+ */
+void release_block(void* ptr) {
+    track_free(ptr);
+}
+
+/**
+ * @brief Release a registry view, and the names it holds.
+ *
+ * @param ptr Pointer to a tRegistryView structure.
+ */
+void release_registry_view(void* ptr) {
+    pRegistryView view = ptr;
+    for (int i = 0; i < view->num_players; i++) {
+        track_free(view->records[i].name);
+    }
+    track_free(view->records);
+    track_free(view);
+}
+
+/**
+ * @brief Release a registry view, but not the names it holds.
+ *
+ * @param ptr Pointer to a tRegistryView structure.
+ */
+void release_registry_shell(void* ptr) {
+    pRegistryView view = ptr;
+    track_free(view->records);
+    track_free(view);
+}
+
+/**
+ * @brief Release a board view.
+ *
+ * @param ptr Pointer to a tBoardView structure.
+ */
+void release_board_view(void* ptr) {
+    pBoardView view = ptr;
+    track_free(view->names[0]);
+    track_free(view->names[1]);
+    track_free(view->sizes);
+    track_free(view->counts);
+    track_free(view->cells);
+    track_free(view);
+}
+
+/**
+ * @brief Retire a block, to be released once no reader can still reach it.
+ *
+ * The block must already be unlinked from the published state. It is tagged
+ * with the current epoch, and the epoch advances, so readers that start
+ * afterwards record a later epoch.
+ *
+ * @param ptr Pointer to the block, or NULL.
+ * @param release The function that releases the block.
+ */
+void retire(void* ptr, void (*release)(void*)) {
+    if (ptr == NULL) {
+        return;
+    }
+    publication.num_retired++;
+    publication.retired = track_realloc(publication.retired, sizeof(tRetired) * publication.num_retired);
+    publication.retired[publication.num_retired - 1] = (tRetired){ptr, release, atomic_fetch_add(&publication.epoch, 1)};
+}
+
+/**
+ * @brief Release the retired blocks that no active reader can reach.
+ *
+ * A block retired in epoch e can only be reached by readers that started in
+ * epoch e or earlier. Never waits for readers: blocks still reachable are kept
+ * until a later call.
+ */
+void reclaim_retired() {
+    if (publication.num_retired == 0) {
+        return;
+    }
+    uint64_t oldest = UINT64_MAX;
+    for (int i = 0; i < SPECTATORS_MAX; i++) {
+        uint64_t reader_epoch = atomic_load(&publication.reader_epochs[i]);
+        if (reader_epoch != 0 && reader_epoch - 1 < oldest) {
+            oldest = reader_epoch - 1;
+        }
+    }
+    int kept = 0;
+    for (int i = 0; i < publication.num_retired; i++) {
+        if (publication.retired[i].epoch < oldest) {
+            publication.retired[i].release(publication.retired[i].ptr);
+        } else {
+            publication.retired[kept++] = publication.retired[i];
+        }
+    }
+    publication.num_retired = kept;
+    if (kept == 0) {
+        track_free(publication.retired);
+        publication.retired = NULL;
+    }
+}
+
+/**
+ * @brief Start an in place change to the published state.
+ */
+void publish_begin() {
+    atomic_fetch_add(&publication.seq, 1);
+}
+
+/**
+ * @brief End an in place change to the published state.
+ */
+void publish_end() {
+    atomic_fetch_add(&publication.seq, 1);
+}
+
+/**
+ * @brief Copy a name.
+ *
+ * This function allocates memory for the copy. It is the responsibility of the
+ * caller to free it.
+ *
+ * @param name The name.
+ * @return char* The copy.
+ */
+char* copy_name(const char* name) {
+    char* copy = track_malloc(strlen(name) + 1);
+    strcpy(copy, name);
+    return copy;
+}
+
+/**
+ * @brief Count the available special sequences of a player, for a board view.
+ *
+ * @param view Pointer to a tBoardView structure.
+ * @param idx 0 for the first player, 1 for the second.
+ * @param player Pointer to the tInGamePlayer structure of the player.
+ */
+void count_view_sequences(pBoardView view, int idx, pInGamePlayer player) {
+    for (int i = 0; i < view->num_sizes; i++) {
+        int count = 0;
+        for (int j = 0; j < player->num_special_sequences; j++) {
+            if (player->special_sequences[j] == view->sizes[i]) {
+                count++;
+            }
+        }
+        view->counts[idx * view->num_sizes + i] = count;
+    }
+}
+
+/**
+ * @brief Publish the game in progress, replacing the current board view.
+ *
+ * @param game Pointer to a tGame structure.
+ */
+void publish_board(pGame game) {
+    if (!publication.enabled) {
+        return;
+    }
+    pBoardView view = NULL;
+    if (game->board != NULL) {
+        view = track_malloc(sizeof(tBoardView));
+        view->width = game->width;
+        view->height = game->height;
+        view->names[0] = copy_name(registry_name(&game->registry, game->player1->player));
+        view->names[1] = copy_name(registry_name(&game->registry, game->player2->player));
+        view->sizes = track_malloc(sizeof(int) * (game->num_special_sequences + 1));
+        view->num_sizes = 0;
+        for (int i = 0; i < game->num_special_sequences; i++) {
+            bool found = false;
+            for (int j = 0; j < view->num_sizes && !found; j++) {
+                found = view->sizes[j] == game->special_sequences[i];
+            }
+            if (!found) {
+                view->sizes[view->num_sizes++] = game->special_sequences[i];
+            }
+        }
+        view->counts = track_malloc(sizeof(int) * (2 * view->num_sizes + 1));
+        count_view_sequences(view, 0, game->player1);
+        count_view_sequences(view, 1, game->player2);
+        view->cells = track_malloc((size_t)game->width * game->height);
+        for (int l = 0; l < game->height; l++) {
+            for (int c = 0; c < game->width; c++) {
+                pInGamePlayer cell = game->board[l][c];
+                view->cells[l * game->width + c] = cell == NULL ? 0 : (cell == game->player1 ? 1 : 2);
+            }
+        }
+    }
+    retire(atomic_exchange(&publication.board, view), release_board_view);
+}
+
+/**
+ * @brief Publish the pieces of a dropped sequence.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param player Pointer to the tInGamePlayer that dropped the sequence.
+ * @param size The size of the sequence.
+ * @param lines The line numbers of the pieces of the sequence.
+ * @param columns The column numbers of the pieces of the sequence.
+ */
+void publish_drop(pGame game, pInGamePlayer player, int size, int* lines, int* columns) {
+    if (!publication.enabled) {
+        return;
+    }
+    pBoardView view = atomic_load(&publication.board);
+    int idx = player == game->player1 ? 0 : 1;
+    publish_begin();
+    for (int i = 0; i < size; i++) {
+        view->cells[lines[i] * view->width + columns[i]] = idx + 1;
+    }
+    count_view_sequences(view, idx, player);
+    publish_end();
+}
+
+/**
+ * @brief Publish the registered players, replacing the current registry view.
+ *
+ * @param game Pointer to a tGame structure.
+ */
+void publish_registry(pGame game) {
+    if (!publication.enabled) {
+        return;
+    }
+    pRegistryView view = track_malloc(sizeof(tRegistryView));
+    pRegistry registry = &game->registry;
+    view->num_players = registry->num_players;
+    view->capacity = registry->num_players > 8 ? registry->num_players : 8;
+    view->records = track_malloc(sizeof(tPlayerRecord) * view->capacity);
+    for (int i = 0; i < registry->num_players; i++) {
+        view->records[i].name = copy_name(registry->names + registry->name_offsets[i]);
+        view->records[i].games_played = registry->games_played[i];
+        view->records[i].wins = registry->wins[i];
+    }
+    retire(atomic_exchange(&publication.registry, view), release_registry_view);
+}
+
+/**
+ * @brief Publish a player appended to the registry.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param player The id of the player.
+ */
+void publish_player_added(pGame game, int player) {
+    if (!publication.enabled) {
+        return;
+    }
+    pRegistryView view = atomic_load(&publication.registry);
+    if (view->num_players == view->capacity) {
+        // Readers may still hold the old view, so it is copied, not reallocated
+        pRegistryView grown = track_malloc(sizeof(tRegistryView));
+        grown->num_players = view->num_players;
+        grown->capacity = view->capacity * 2;
+        grown->records = track_malloc(sizeof(tPlayerRecord) * grown->capacity);
+        memcpy(grown->records, view->records, sizeof(tPlayerRecord) * view->num_players);
+        atomic_store(&publication.registry, grown);
+        retire(view, release_registry_shell);
+        view = grown;
+    }
+    int idx = game->registry.index[player];
+    char* name = copy_name(registry_name(&game->registry, player));
+    publish_begin();
+    view->records[view->num_players] = (tPlayerRecord){name, game->registry.games_played[idx], game->registry.wins[idx]};
+    view->num_players++;
+    publish_end();
+}
+
+/**
+ * @brief Publish the removal of a player from the registry.
+ *
+ * @param idx The index of the player in the registry arrays.
+ */
+void publish_player_removed(int idx) {
+    if (!publication.enabled) {
+        return;
+    }
+    pRegistryView view = atomic_load(&publication.registry);
+    char* name = view->records[idx].name;
+    publish_begin();
+    memmove(&view->records[idx], &view->records[idx + 1], sizeof(tPlayerRecord) * (view->num_players - idx - 1));
+    view->num_players--;
+    publish_end();
+    retire(name, release_block);
+}
+
+/**
+ * @brief Publish the records of a player.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param player The id of the player.
+ */
+void publish_player_records(pGame game, int player) {
+    if (!publication.enabled) {
+        return;
+    }
+    pRegistryView view = atomic_load(&publication.registry);
+    int idx = game->registry.index[player];
+    publish_begin();
+    view->records[idx].games_played = game->registry.games_played[idx];
+    view->records[idx].wins = game->registry.wins[idx];
+    publish_end();
+}
+
+/**
+ * @brief Create and initialize a new game.
+ *
+ * This function creates and initializes a new game, allocating memory for the
+ * structure. It is the responsibility of the caller to free this memory.
+ *
+ * @return pGame Pointer to a malloc reserved tGame structure.
+ */
+pGame new_game() {
+    pGame game = track_malloc(sizeof(tGame));
+    game->registry = (tRegistry){0};
+    game->player1 = NULL;
+    game->player2 = NULL;
+    game->special_sequences = NULL;
+    game->width = -1;
+    game->height = -1;
+    game->sequence_size = -1;
+    game->num_special_sequences = 0;
+    game->board = NULL;
+    game->engine = NULL;
+    game->reference = false;
+    game->version = 0;
+    game->dropped_version = 0;
+    game->changes_start = 0;
+    game->num_changes = 0;
+    game->wins_ranking = (tRanking){.compare = comp_wins, .registry = &game->registry};
+    game->rate_ranking = (tRanking){.compare = comp_win_rate, .registry = &game->registry};
+    game->windows = NULL;
+    game->open_windows[0] = 0;
+    game->open_windows[1] = 0;
+    game->empty_cells = 0;
+    game->move_log = (tByteBuffer){NULL, 0, 0};
+    game->num_moves = 0;
+    game->archive = NULL;
+    return game;
+}
+
+void free_bot(tBot* bot);
+
+/**
+ * @brief Frees the memory associated to a tGame.
+ *
+ * This function frees the memory associated to a tGame, and dependencies.
+ *
+ * @param game Pointer to a tGame structure.
+ */
+void free_game(pGame game) {
+    free_registry(&game->registry);
+    if (game->player1 != NULL) {
+        free_bot(game->player1->bot);
+        track_free(game->player1->special_sequences);
+        track_free(game->player1);
+    }
+    if (game->player2 != NULL) {
+        free_bot(game->player2->bot);
+        track_free(game->player2->special_sequences);
+        track_free(game->player2);
+    }
+    if (game->special_sequences != NULL) {
+        track_free(game->special_sequences);
+    }
+    if (game->board != NULL) {
+        for (int r = 0; r < game->height; r++) {
+            track_free(game->board[r]);
+        }
+        track_free(game->board);
+    }
+    track_free(game->windows);
+    buffer_free(&game->move_log);
+    free_ranking(&game->wins_ranking);
+    free_ranking(&game->rate_ranking);
+    track_free(game);
+}
+
+/**
+ * @brief Get the player idx object
+ *
+ * This function returns the index of the player in the registry arrays, or -1
+ * if not found.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param name The name of the player.
+ * @return int The index of the player in the registry arrays, or -1 if not
+ * found.
+ */
+int get_player_idx(pGame game, char* name) {
+    return registry_find(&game->registry, name);
+}
+
+/**
+ * @brief Get the player object
+ *
+ * This function returns the id of the player, or -1 if the player is not found.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param name The name of the player.
+ * @return int The id of the player, or -1 if not found.
+ */
+int get_player(pGame game, char* name) {
+    int idx = get_player_idx(game, name);
+    if (idx != -1) {
+        return game->registry.ids[idx];
+    }
+    return -1;
+}
+
+/**
+ * @brief Check if a player exists in the game.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param name The name of the player.
+ * @return true If the player exists.
+ * @return false If the player does not exist.
+ */
+bool has_player(pGame game, char* name) {
+    return get_player(game, name) != -1;
+}
+
+/**
+ * @brief Add a player to the game.
+ *
+ * This function appends the player to the registry, which doubles its arrays
+ * when they are full, and inserts it in the rankings.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param name The name of the player.
+ */
+void add_player(pGame game, char* name) {
+    int id = registry_add(&game->registry, name);
+    rankings_insert(game, id);
+    publish_player_added(game, id);
+}
+
+/**
+ * @brief Remove a player from the set of registered players.
+ *
+ * This functions removes the player from the rankings and from the registry.
+ * The registry arrays keep their capacity.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param name The name of the player.
+ */
+void remove_player(pGame game, char* name) {
+    int idx = get_player_idx(game, name);
+    rankings_remove(game, game->registry.ids[idx]);
+    publish_player_removed(idx);
+    registry_remove(&game->registry, idx);
+}
+
+/**
+ * @brief Check if a player is in the current game.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param name The name of the player.
+ * @return true If the player is in the game.
+ * @return false If the player is not in the game.
+ */
+bool player_in_game(pGame game, char* name) {
+    int player = get_player(game, name);
+    return player != -1 && (game->player1->player == player || game->player2->player == player);
+}
+
+/**
+ * @brief Check if the game has any registered players.
+ *
+ * @param game Pointer to a tGame structure.
+ * @return true If the game has any players.
+ * @return false If the game has no players.
+ */
+bool has_players(pGame game) {
+    return game->registry.num_players > 0;
+}
+
+/**
+ * @brief Comparison function for sorting players of sort_registry by name.
+ *
+ * @param p1 Pointer to the index of a player in the registry arrays.
+ * @param p2 Pointer to the index of a player in the registry arrays.
+ * @return int The result of the comparison between player names.
+ */
+int comp_players(const void* p1, const void* p2) {
+    return strcmp(sort_registry->names + sort_registry->name_offsets[*(const int*)p1], sort_registry->names + sort_registry->name_offsets[*(const int*)p2]);
+}
+
+/**
+ * @brief Check if there is a game in progress.
+ *
+ * @param game Pointer to a tGame structure.
+ * @return true If there is a game in progress.
+ * @return false If there is no game in progress.
+ */
+bool in_game(pGame game) {
+    return game->board != NULL;
+}
+
+/**
+ * @brief Check if the given dimensions are valid.
+ *
+ * The dimensions are valid if the height is greater than or equal to half of the width.
+ *
+ * @param width The width of the board.
+ * @param height The height of the board.
+ * @return true If the dimensions are valid.
+ * @return false If the dimensions are not valid.
+ */
+bool valid_dimensions(int width, int height) {
+    return height >= width / 2;
+}
+
+/**
+ * @brief Check if the given winning sequence size is valid.
+ *
+ * The sequence size is valid if it is less than the width of the board.
+ *
+ * @param width The width of the board.
+ * @param sequence_size The size of the sequence.
+ * @return true If the sequence size is valid.
+ * @return false If the sequence size is not valid.
+ */
+bool valid_sequence(int width, int sequence_size) {
+    return width > sequence_size;
+}
+
+/**
+ * @brief Check if the given special sequences are valid.
+ *
+ * The special sequences are valid if they are less than the winning sequence size.
+ *
+ * @param sequence_size The size of the winning sequence.
+ * @param special_sequences Array of special sequence sizes.
+ * @param num_special_sequences The number of special sequence sizes.
+ * @return true If the special sequence sizes are valid.
+ * @return false If the special sequence sizes are not valid.
+ */
+bool valid_special_sequences(int sequence_size, int* special_sequences, int num_special_sequences) {
+    for (int i = 0; i < num_special_sequences; i++) {
+        if (special_sequences[i] >= sequence_size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Allocate memory for, and initialize, a new tInGamePlayer structure.
+ *
+ * This function allocates memory for a new tInGamePlayer structure, and
+ * initializes it. It returns a pointer to the new structure in the player
+ * parameter.
+ *
+ * This function allocates memory for the special sequences array, and is the
+ * responsibility of the caller to free it.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param[out] player Pointer to a pInGamePlayer structure pointer.  It will be
+ * set to point to the new tInGamePlayer structure.
+ * @param name The name of the player.
+ * @param special_sequences Array of special sequence sizes.
+ * @param num_special_sequences The number of special sequence sizes.
+ */
+void start_game_player(pGame game, pInGamePlayer* player, char* name, int* special_sequences, int num_special_sequences) {
+    (*player) = track_malloc(sizeof(tInGamePlayer));
+    (*player)->player = get_player(game, name);
+    (*player)->special_sequences = track_malloc(sizeof(int) * num_special_sequences);
+    memcpy((*player)->special_sequences, special_sequences, sizeof(int) * num_special_sequences);
+    (*player)->num_special_sequences = num_special_sequences;
+    (*player)->bot = NULL;
+}
+
+void select_engine(pGame game);
+
+/**
+ * @brief Start a new board version, discarding all recorded changes.
+ *
+ * Used when the whole board is replaced, so that delta views of previous
+ * versions fall back to the full board.
+ *
+ * @param game Pointer to a tGame structure.
+ */
+void reset_changes(pGame game) {
+    game->version++;
+    game->dropped_version = game->version;
+    game->changes_start = 0;
+    game->num_changes = 0;
+}
+
+/**
+ * @brief Record a change to a board position in the current version.
+ *
+ * When the ring buffer is full, the oldest change is dropped.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param line The line of the changed position.
+ * @param column The column of the changed position.
+ */
+void record_change(pGame game, int line, int column) {
+    if (game->num_changes == CHANGES_CAPACITY) {
+        game->dropped_version = game->changes[game->changes_start].version;
+        game->changes_start = (game->changes_start + 1) % CHANGES_CAPACITY;
+        game->num_changes--;
+    }
+    int idx = (game->changes_start + game->num_changes) % CHANGES_CAPACITY;
+    game->changes[idx].version = game->version;
+    game->changes[idx].line = line;
+    game->changes[idx].column = column;
+    game->num_changes++;
+}
+
+/**
+ * @brief Line and column shifts of the four directions of a sequence.
+ *
+ * Horizontal, vertical, diagonal (down and right) and anti-diagonal (down and
+ * left), with the same meaning as the shifts of count_pieces.
+ *
+ * Used by the threat map, the completable windows and the solver.
+ */
+static const int THREAT_SHIFTS[4][2] = {{0, 1}, {1, 0}, {1, 1}, {1, -1}};
+
+/**
+ * @brief Check if a window fits the board.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param direction Index of the direction in THREAT_SHIFTS.
+ * @param line The line of the first cell of the window.
+ * @param column The column of the first cell of the window.
+ * @return bool True if all the cells of the window are on the board.
+ */
+bool window_fits(pGame game, int direction, int line, int column) {
+    int last_line = line + (game->sequence_size - 1) * THREAT_SHIFTS[direction][0];
+    int last_column = column + (game->sequence_size - 1) * THREAT_SHIFTS[direction][1];
+    return line >= 0 && column >= 0 && column < game->width && last_line < game->height && last_column >= 0 && last_column < game->width;
+}
+
+/**
+ * @brief Record a piece in the windows that contain it, for given dimensions.
+ *
+ * Always inlined, so that specialized engines get constant dimensions and
+ * unrolled loops when compiled with optimizations.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param player_idx 0 for the first player, 1 for the second.
+ * @param line The line of the piece.
+ * @param column The column of the piece.
+ * @param width The width of the board.
+ * @param height The height of the board.
+ * @param sequence_size The size of the winning sequence.
+ */
+static inline __attribute__((always_inline)) void update_windows_at(pGame game, int player_idx, int line, int column, int width, int height, int sequence_size) {
+    for (int direction = 0; direction < 4; direction++) {
+        for (int k = 0; k < sequence_size; k++) {
+            int l = line - k * THREAT_SHIFTS[direction][0];
+            int c = column - k * THREAT_SHIFTS[direction][1];
+            int last_line = l + (sequence_size - 1) * THREAT_SHIFTS[direction][0];
+            int last_column = c + (sequence_size - 1) * THREAT_SHIFTS[direction][1];
+            if (l < 0 || c < 0 || c >= width || last_line >= height || last_column < 0 || last_column >= width) continue;
+            uint8_t* window = &game->windows[(direction * height + l) * width + c];
+            if ((*window & (1 << player_idx)) == 0) {
+                game->open_windows[1 - player_idx]--;
+            }
+            *window |= 1 << player_idx;
+        }
+    }
+    game->empty_cells--;
+}
+
+/**
+ * @brief Record a piece in the windows that contain it.
+ *
+ * A window with a piece of a player can no longer be completed by the other
+ * player, which loses one open window the first time this happens.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param player_idx 0 for the first player, 1 for the second.
+ * @param line The line of the piece.
+ * @param column The column of the piece.
+ */
+void update_windows(pGame game, int player_idx, int line, int column) {
+    update_windows_at(game, player_idx, line, column, game->width, game->height, game->sequence_size);
+}
+
+/**
+ * @brief Free the windows of the current game.
+ *
+ * @param game Pointer to a tGame structure.
+ */
+void free_windows(pGame game) {
+    track_free(game->windows);
+    game->windows = NULL;
+}
+
+/**
+ * @brief Compute the windows of the current game from its board.
+ *
+ * @param game Pointer to a tGame structure.
+ */
+void reset_windows(pGame game) {
+    size_t num_windows = (size_t)4 * game->height * game->width;
+    free_windows(game);
+    game->windows = track_malloc(num_windows);
+    memset(game->windows, 0, num_windows);
+    game->open_windows[0] = 0;
+    for (int direction = 0; direction < 4; direction++) {
+        for (int l = 0; l < game->height; l++) {
+            for (int c = 0; c < game->width; c++) {
+                game->open_windows[0] += window_fits(game, direction, l, c);
+            }
+        }
+    }
+    game->open_windows[1] = game->open_windows[0];
+    game->empty_cells = game->height * game->width;
+    for (int l = 0; l < game->height; l++) {
+        for (int c = 0; c < game->width; c++) {
+            if (game->board[l][c] != NULL) {
+                update_windows(game, game->board[l][c] == game->player1 ? 0 : 1, l, c);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Check if the current game can no longer be won.
+ *
+ * This is the case when the board is full, or when every window has pieces of
+ * both players.
+ *
+ * @param game Pointer to a tGame structure.
+ * @return bool True if neither player can win.
+ */
+bool dead_game(pGame game) {
+    return game->empty_cells == 0 || (game->open_windows[0] == 0 && game->open_windows[1] == 0);
+}
+
+/**
+ * @brief Start a new game.
+ *
+ * This function starts a new game. It initializes the players, the board, and
+ * the winning sequence size.
+ *
+ * This function allocates memory for the board, and for the special sequences
+ * of the players. It is the responsibility of the caller to free this memory.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param player1_name The name of the first player.
+ * @param player2_name The name of the second player.
+ * @param width The width of the board.
+ * @param height The height of the board.
+ * @param sequence_size The size of the winning sequence.
+ * @param special_sequences Array of special sequence sizes.
+ * @param num_special_sequences The number of special sequence sizes.
+ */
+void start_game(pGame game, char* player1_name, char* player2_name, int width, int height, int sequence_size, int* special_sequences, int num_special_sequences) {
+    start_game_player(game, &(game->player1), player1_name, special_sequences, num_special_sequences);
+    start_game_player(game, &(game->player2), player2_name, special_sequences, num_special_sequences);
+    game->sequence_size = sequence_size;
+    game->special_sequences = track_malloc(sizeof(int) * num_special_sequences);
+    memcpy(game->special_sequences, special_sequences, sizeof(int) * num_special_sequences);
+    game->num_special_sequences = num_special_sequences;
+    game->width = width;
+    game->height = height;
+    game->board = track_malloc(sizeof(pInGamePlayer*) * game->height);
+    for (int r = 0; r < game->height; r++) {
+        game->board[r] = track_malloc(sizeof(pInGamePlayer) * game->width);
+        for (int c = 0; c < game->width; c++) {
+            game->board[r][c] = NULL;
+        }
+    }
+    reset_changes(game);
+    reset_windows(game);
+    buffer_free(&game->move_log);
+    game->num_moves = 0;
+    select_engine(game);
+    publish_board(game);
+}
+
+/**
+ * @brief Build an array of unique special sequences from the current game.
+ *
+ * This function builds an array of unique special sequences from the current
+ * game. It returns a pointer to the array, and sets the
+ * num_unique_special_sequences parameter to the number of unique special
+ * sequences.
+ *
+ * This function allocates memory for the array. It is the responsibility of the
+ * caller to free the memory.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param num_unique_special_sequences Pointer to an int. It will be set to the
+ * number of unique special sequences.
+ * @return int* Pointer to an array of unique special sequences.
+ */
+int* get_unique_special_sequences(pGame game, int* num_unique_special_sequences) {
+    int* unique_special_sequences = NULL;
+    *num_unique_special_sequences = 0;
+    for (int i = 0; i < game->num_special_sequences; i++) {
         bool found = false;
         for (int j = 0; j < *num_unique_special_sequences; j++) {
             if (game->special_sequences[i] == unique_special_sequences[j]) {
@@ -386,655 +2101,4886 @@ int* get_unique_special_sequences(pGame game, int* num_unique_special_sequences)
                 break;
             }
         }
-        if (!found) {
-            (*num_unique_special_sequences)++;
-            unique_special_sequences = realloc(unique_special_sequences, sizeof(int) * *num_unique_special_sequences);
-            unique_special_sequences[*num_unique_special_sequences - 1] = game->special_sequences[i];
+        if (!found) {
+            (*num_unique_special_sequences)++;
+            unique_special_sequences = track_realloc(unique_special_sequences, sizeof(int) * *num_unique_special_sequences);
+            unique_special_sequences[*num_unique_special_sequences - 1] = game->special_sequences[i];
+        }
+    }
+    return unique_special_sequences;
+}
+
+/**
+ * @brief Get the in game player object.
+ *
+ * This function returns the in game player object for the player with the given
+ * name.
+ *
+ * An inGamePlayer object is a structure that contains a pointer to the player
+ * object and its special sequences.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param name The name of the player.
+ * @return pInGamePlayer Pointer to the in game player object.
+ */
+pInGamePlayer get_in_game_player(pGame game, char* name) {
+    if (strcmp(registry_name(&game->registry, game->player1->player), name) == 0) {
+        return game->player1;
+    }
+    return game->player2;
+}
+
+/**
+ * @brief Get the other InGamePlayer object.
+ *
+ * Returns the InGamePlayer object for the player with a different name.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param name The name of the opposite player.
+ * @return pInGamePlayer Pointer to an InGamePlayer object.
+ */
+pInGamePlayer get_other_in_game_player(pGame game, char* name) {
+    if (strcmp(registry_name(&game->registry, game->player1->player), name) == 0) {
+        return game->player2;
+    }
+    return game->player1;
+}
+
+/**
+ * @brief Validate the size of a special sequence.
+ *
+ * This function validates the size of a special sequence. It returns true if
+ * the size is available to the player with the given name.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param name The name of the player.
+ * @param size The size of the special sequence.
+ * @return true If the size is available to the player.
+ * @return false If the size is not available to the player.
+ */
+bool valid_size(pGame game, char* name, int size) {
+    if (size == 1) return true;
+    if (size <= 0) return false;
+
+    pInGamePlayer player = get_in_game_player(game, name);
+    for (int i = 0; i < player->num_special_sequences; i++) {
+        if (player->special_sequences[i] == size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Get the starting column.
+ *
+ * This function returns the starting column for a sequence of the given size,
+ * placed in the given column, and with the given direction.
+ *
+ * The stating column is the leftmost column where the sequence would be placed.
+ *
+ * @param size The size of the sequence.
+ * @param column The column where the sequence is placed.
+ * @param direction The direction of the sequence.
+ * @return int The starting (leftmost) column.
+ */
+int get_starting_column(int size, int column, char* direction) {
+    int dir = 1;
+    if (direction != NULL) {
+        dir = strcmp(direction, "D") == 0 ? 0 : -1;
+    }
+    int col = column - 1;
+    int shift = (size - 1) * dir;
+    return col + shift;
+}
+
+/**
+ * @brief Check if a position is valid.
+ *
+ * This function checks if a position is valid. A position is valid if it is
+ * within the board, and if all its pieces could be placed in the first (top)
+ * row.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param size The size of the sequence.
+ * @param column The column where the sequence is placed.
+ * @param direction The direction of the sequence.
+ * @return bool True if the position is valid, false otherwise.
+ */
+bool valid_position(pGame game, int size, int column, char* direction) {
+    int col = get_starting_column(size, column, direction);
+    if (col < 0 || col + size > game->width) {
+        return false;
+    }
+    for (int c = col; c < col + size; c++) {
+        if (game->board[0][c] != NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Remove a special sequence from a player.
+ *
+ * This function removes a special sequence size instance from a player.
+ *
+ * @param player Pointer to a tInGamePlayer structure.
+ * @param size The size of the special sequence.
+ */
+void remove_special_sequence(pInGamePlayer player, int size) {
+    for (int i = 0; i < player->num_special_sequences; i++) {
+        if (player->special_sequences[i] == size) {
+            int offset = player->num_special_sequences - i - 1;
+            memmove(&(player->special_sequences[i]), &(player->special_sequences[i + 1]), offset * sizeof(int));
+            player->num_special_sequences--;
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Complete the drop of a sequence, for given dimensions.
+ *
+ * Always inlined, so that specialized engines update the completable windows
+ * with constant dimensions (see update_windows_at).
+ *
+ * @param game Pointer to a tGame structure.
+ * @param player Pointer to the tInGamePlayer that dropped the sequence.
+ * @param size The size of the sequence.
+ * @param lines The line numbers of the pieces of the sequence.
+ * @param columns The column numbers of the pieces of the sequence.
+ * @param width The width of the board.
+ * @param height The height of the board.
+ * @param sequence_size The size of the winning sequence.
+ */
+static inline __attribute__((always_inline)) void finish_drop_at(pGame game, pInGamePlayer player, int size, int* lines, int* columns, int width, int height, int sequence_size) {
+    int player_idx = player == game->player1 ? 0 : 1;
+    game->version++;
+    buffer_put_varint(&game->move_log, (uint64_t)size << 1 | player_idx);
+    for (int i = 0; i < size; i++) {
+        record_change(game, lines[i], columns[i]);
+        update_windows_at(game, player_idx, lines[i], columns[i], width, height, sequence_size);
+        buffer_put_varint(&game->move_log, lines[i]);
+        buffer_put_varint(&game->move_log, columns[i]);
+    }
+    game->num_moves++;
+    if (size > 1) {
+        remove_special_sequence(player, size);
+    }
+    publish_drop(game, player, size, lines, columns);
+}
+
+/**
+ * @brief Complete the drop of a sequence.
+ *
+ * Records the placed pieces as a new board version, in the completable
+ * windows and in the move log, and removes the special sequence from the
+ * player. Shared by all engines.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param player Pointer to the tInGamePlayer that dropped the sequence.
+ * @param size The size of the sequence.
+ * @param lines The line numbers of the pieces of the sequence.
+ * @param columns The column numbers of the pieces of the sequence.
+ */
+void finish_drop(pGame game, pInGamePlayer player, int size, int* lines, int* columns) {
+    finish_drop_at(game, player, size, lines, columns, game->width, game->height, game->sequence_size);
+}
+
+/**
+ * @brief Drop a sequence.
+ *
+ * This function drops a sequence of the given size, placed in the given column,
+ * and with the given direction.
+ *
+ * The function returns the placement coordinates of the pieces of the sequence,
+ * and records them as a new board version.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param name The name of the player.
+ * @param size The size of the sequence.
+ * @param column The column where the sequence is placed.
+ * @param direction The direction of the sequence.
+ * @param[out] lines The line numbers of the pieces of the sequence.
+ * @param[out] cols The column numbers of the pieces of the sequence.
+ */
+void drop(pGame game, char* name, int size, int column, char* direction, int* lines, int* columns) {
+    pInGamePlayer player = get_in_game_player(game, name);
+    int col = get_starting_column(size, column, direction);
+    int idx = 0;
+    for (int c = col; c < col + size; c++) {
+        bool placed = false;
+        for (int l = 0; l < game->height && !placed; l++) {
+            if (game->board[l][c] != NULL) {
+                game->board[l - 1][c] = player;
+                lines[idx] = l - 1;
+                columns[idx] = c;
+                placed = true;
+            }
+        }
+        if (!placed) {
+            game->board[game->height - 1][c] = player;
+            lines[idx] = game->height - 1;
+            columns[idx] = c;
+        }
+        idx++;
+    }
+    finish_drop(game, player, size, lines, columns);
+}
+
+/**
+ * @brief Count pieces in a given direction.
+ *
+ * This function counts the number of pieces of the given player in a given
+ * direction, starting from the given line and column.
+ *
+ * The direction is given by the l_shift and c_shift parameters. For example, to
+ * count the number of pieces in the direction of the top-left diagonal, the
+ * l_shift and c_shift parameters should be -1 and -1, respectively.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param player Pointer to a tInGamePlayer structure.
+ * @param line The line where the counting starts.
+ * @param column The column where the counting starts.
+ * @param l_shift The line shift.
+ * @param c_shift The column shift.
+ * @return int The number of pieces in the given direction.
+ */
+int count_pieces(pGame game, pInGamePlayer player, int line, int column, int l_shift, int c_shift) {
+    int count = 0;
+    int l = line;
+    int c = column;
+    while (l >= 0 && l < game->height && c >= 0 && c < game->width && game->board[l][c] == player) {
+        if (!(l == line && c == column)) {
+            count++;
+        }
+        l += l_shift;
+        c += c_shift;
+    }
+    return count;
+}
+
+/**
+ * @brief Check if a player won the game.
+ *
+ * This function checks if the given player wins. The player wins if he has a
+ * sequence equal to or greater than the number of pieces required to win. The
+ * given line and column indicate one of the positions recently placed by the
+ * player. Sequences count horizontally, vertically and along both diagonals.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param name The name of the player.
+ * @param line The line where the piece was placed.
+ * @param column The column where the piece was placed.
+ * @return bool True if the player wins, false otherwise.
+ */
+bool player_wins(pGame game, char* name, int line, int column) {
+    pInGamePlayer player = get_in_game_player(game, name);
+    // -1,-1 |       -1,0      | -1,+1
+    // --------------------------------
+    //  0,-1 |   line,column   |  0,+1
+    // --------------------------------
+    // +1,+1 |       +1,0      | -1,0
+    for (int l_shift = 0; l_shift <= 1; l_shift++) {
+        for (int c_shift = -1; c_shift <= 1; c_shift++) {
+            // Each direction is counted both ways, so 0,0 and 0,-1 are skipped
+            if (l_shift == 0 && c_shift <= 0) {
+                continue;
+            }
+            int start_segment = count_pieces(game, player, line, column, l_shift, c_shift);
+            int end_segment = count_pieces(game, player, line, column, -l_shift, -c_shift);
+            if ((start_segment + 1 + end_segment) >= game->sequence_size) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief An engine for the board operations of CP.
+ *
+ * The generic engine works for any board. Specialized engines are generated by
+ * DEFINE_ENGINE for a fixed width, height and sequence size, and registered in
+ * ENGINES.
+ */
+struct tEngine {
+    int width;          ///< The width of the board, 0 for the generic engine.
+    int height;         ///< The height of the board, 0 for the generic engine.
+    int sequence_size;  ///< The size of the winning sequence, 0 for the generic engine.
+    void (*drop)(pGame, char*, int, int, char*, int*, int*);  ///< Same contract as drop.
+    bool (*wins)(pGame, char*, int, int);                    ///< Same contract as player_wins.
+};
+
+/**
+ * @brief Get the index of a player in the engine state.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param player Pointer to a tInGamePlayer structure.
+ * @return int 0 for the first player, 1 for the second.
+ */
+int engine_player_idx(pGame game, pInGamePlayer player) {
+    return player == game->player1 ? 0 : 1;
+}
+
+/**
+ * @brief Drop a sequence, using the engine state.
+ *
+ * Same contract as drop, but each piece lands in constant time, on top of the
+ * first occupied line of its column, and the completable windows are updated
+ * with the given dimensions.
+ *
+ * Always inlined, so that specialized engines get constant dimensions.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param name The name of the player.
+ * @param size The size of the sequence.
+ * @param column The column where the sequence is placed.
+ * @param direction The direction of the sequence.
+ * @param[out] lines The line numbers of the pieces of the sequence.
+ * @param[out] columns The column numbers of the pieces of the sequence.
+ * @param width The width of the board.
+ * @param height The height of the board.
+ * @param sequence_size The size of the winning sequence.
+ */
+static inline __attribute__((always_inline)) void drop_masks(pGame game, char* name, int size, int column, char* direction, int* lines, int* columns, int width, int height, int sequence_size) {
+    pInGamePlayer player = get_in_game_player(game, name);
+    uint32_t* pieces = game->engine_state.pieces[engine_player_idx(game, player)];
+    int col = get_starting_column(size, column, direction);
+    for (int i = 0; i < size; i++) {
+        int c = col + i;
+        int l = --game->engine_state.top[c];
+        game->board[l][c] = player;
+        pieces[l] |= 1u << c;
+        lines[i] = l;
+        columns[i] = c;
+    }
+    finish_drop_at(game, player, size, lines, columns, width, height, sequence_size);
+}
+
+/**
+ * @brief Check if a player won the game, using the engine state.
+ *
+ * Same contract as player_wins, checking the same directions. Instead of
+ * walking the board, complete windows are found by combining row masks: bit s
+ * of the AND of sequence_size shifted masks is set when the window starting in
+ * column s is complete. Only windows containing the given position count.
+ *
+ * Always inlined, so that specialized engines get constant dimensions and
+ * unrolled loops when compiled with optimizations.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param name The name of the player.
+ * @param line The line where the piece was placed.
+ * @param column The column where the piece was placed.
+ * @param height The height of the board.
+ * @param sequence_size The size of the winning sequence.
+ * @param start_masks The precomputed window starts of each column (see START_MASKS).
+ * @return bool True if the player wins, false otherwise.
+ */
+static inline __attribute__((always_inline)) bool wins_masks(pGame game, char* name, int line, int column, int height, int sequence_size, const uint32_t* start_masks) {
+    pInGamePlayer player = get_in_game_player(game, name);
+    const uint32_t* pieces = game->engine_state.pieces[engine_player_idx(game, player)];
+    uint32_t starts = start_masks[column];
+
+    uint32_t horizontal = pieces[line];
+    for (int k = 1; k < sequence_size; k++) {
+        horizontal &= pieces[line] >> k;
+    }
+    if (horizontal & starts) {
+        return true;
+    }
+    for (int j = 0; j < sequence_size; j++) {
+        int first_line = line - j;
+        if (first_line < 0 || first_line + sequence_size > height) {
+            continue;
+        }
+        uint32_t vertical = pieces[first_line];
+        uint32_t diagonal = pieces[first_line];
+        uint32_t anti_diagonal = pieces[first_line];
+        for (int k = 1; k < sequence_size; k++) {
+            vertical &= pieces[first_line + k];
+            diagonal &= pieces[first_line + k] >> k;
+            anti_diagonal &= pieces[first_line + k] << k;
+        }
+        if ((vertical >> column) & 1) {
+            return true;
+        }
+        if (column - j >= 0 && (diagonal >> (column - j)) & 1) {
+            return true;
+        }
+        if (column + j < ENGINE_MAX_WIDTH && (anti_diagonal >> (column + j)) & 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief The starting columns of the windows of N positions containing column C.
+ *
+ * Bits max(0, C - N + 1) to C, as a constant expression.
+ */
+#define START_MASK(N, C) ((uint32_t)(((2ull << (C)) - 1) & ~((1ull << ((C) >= (N) - 1 ? (C) - (N) + 1 : 0)) - 1)))
+
+/**
+ * @brief The START_MASK of every column of a row mask, for windows of N positions.
+ */
+#define START_MASKS(N)                                                                                  \
+    {START_MASK(N, 0),  START_MASK(N, 1),  START_MASK(N, 2),  START_MASK(N, 3),  START_MASK(N, 4),  \
+     START_MASK(N, 5),  START_MASK(N, 6),  START_MASK(N, 7),  START_MASK(N, 8),  START_MASK(N, 9),  \
+     START_MASK(N, 10), START_MASK(N, 11), START_MASK(N, 12), START_MASK(N, 13), START_MASK(N, 14), \
+     START_MASK(N, 15), START_MASK(N, 16), START_MASK(N, 17), START_MASK(N, 18), START_MASK(N, 19), \
+     START_MASK(N, 20), START_MASK(N, 21), START_MASK(N, 22), START_MASK(N, 23), START_MASK(N, 24), \
+     START_MASK(N, 25), START_MASK(N, 26), START_MASK(N, 27), START_MASK(N, 28), START_MASK(N, 29), \
+     START_MASK(N, 30), START_MASK(N, 31)}
+
+/**
+ * @brief Define a specialized engine.
+ *
+ * Generates drop_WxHxN and player_wins_WxHxN, where the board dimensions and
+ * sequence size are compile time constants, and the window starts of each
+ * column are a constant table. Engines must also be registered in ENGINES.
+ */
+#define DEFINE_ENGINE(W, H, N)                                                                                       \
+    static const uint32_t START_MASKS_##W##x##H##x##N[ENGINE_MAX_WIDTH] = START_MASKS(N);                            \
+    void drop_##W##x##H##x##N(pGame game, char* name, int size, int column, char* direction, int* lines, int* columns) { \
+        drop_masks(game, name, size, column, direction, lines, columns, W, H, N);                                    \
+    }                                                                                                                \
+    bool player_wins_##W##x##H##x##N(pGame game, char* name, int line, int column) {                                 \
+        return wins_masks(game, name, line, column, H, N, START_MASKS_##W##x##H##x##N);                              \
+    }
+
+DEFINE_ENGINE(7, 6, 4)
+DEFINE_ENGINE(9, 7, 5)
+DEFINE_ENGINE(15, 10, 6)
+
+/**
+ * @brief The specialized engines, by width, height and sequence size.
+ */
+static const tEngine ENGINES[] = {
+    {7, 6, 4, drop_7x6x4, player_wins_7x6x4},
+    {9, 7, 5, drop_9x7x5, player_wins_9x7x5},
+    {15, 10, 6, drop_15x10x6, player_wins_15x10x6},
+};
+
+/**
+ * @brief The generic engine, used when no specialized engine matches.
+ */
+static const tEngine GENERIC_ENGINE = {0, 0, 0, drop, player_wins};
+
+/**
+ * @brief Select the engine of the current game.
+ *
+ * Selects the specialized engine matching the board dimensions and sequence
+ * size, building its state from the board, or the generic engine. Reference
+ * games always use the generic engine.
+ *
+ * @param game Pointer to a tGame structure.
+ */
+void select_engine(pGame game) {
+    game->engine = &GENERIC_ENGINE;
+    for (size_t i = 0; i < sizeof(ENGINES) / sizeof(ENGINES[0]) && !game->reference; i++) {
+        if (ENGINES[i].width == game->width && ENGINES[i].height == game->height && ENGINES[i].sequence_size == game->sequence_size) {
+            game->engine = &ENGINES[i];
+        }
+    }
+    if (game->engine == &GENERIC_ENGINE) {
+        return;
+    }
+    memset(&game->engine_state, 0, sizeof(tEngineState));
+    for (int c = 0; c < game->width; c++) {
+        game->engine_state.top[c] = game->height;
+        for (int l = game->height - 1; l >= 0 && game->board[l][c] != NULL; l--) {
+            game->engine_state.pieces[engine_player_idx(game, game->board[l][c])][l] |= 1u << c;
+            game->engine_state.top[c] = l;
+        }
+    }
+}
+
+/**
+ * @brief The threat map of a player.
+ *
+ * Counts, for each direction, the windows of sequence_size positions without
+ * pieces of the opponent, where the player is one or two pieces short of a
+ * winning sequence.
+ */
+typedef struct {
+    int one_short[4];  ///< Windows missing one piece, per direction.
+    int two_short[4];  ///< Windows missing two pieces, per direction.
+} tThreats;
+
+/**
+ * @brief Evaluate THREAT_LANES consecutive windows, one at a time.
+ *
+ * @param mine Occupancy of the player at the first position of the first window.
+ * @param theirs Occupancy of the opponent at the same position.
+ * @param step Offset between consecutive positions of a window.
+ * @param sequence_size The size of the winning sequence.
+ * @param lanes The number of windows to evaluate.
+ * @param[out] one_short Bit mask of the windows missing one piece.
+ * @param[out] two_short Bit mask of the windows missing two pieces.
+ */
+void threat_lanes_scalar(const uint8_t* mine, const uint8_t* theirs, long step, int sequence_size, int lanes, uint32_t* one_short, uint32_t* two_short) {
+    *one_short = 0;
+    *two_short = 0;
+    for (int lane = 0; lane < lanes; lane++) {
+        int mine_count = 0;
+        int theirs_count = 0;
+        for (int k = 0; k < sequence_size; k++) {
+            mine_count += mine[lane + k * step];
+            theirs_count += theirs[lane + k * step];
+        }
+        if (theirs_count == 0 && mine_count == sequence_size - 1) {
+            *one_short |= 1u << lane;
+        } else if (theirs_count == 0 && mine_count == sequence_size - 2) {
+            *two_short |= 1u << lane;
+        }
+    }
+}
+
+#if THREAT_LANES > 1
+/**
+ * @brief Evaluate THREAT_LANES consecutive windows with SIMD instructions.
+ *
+ * Piece counts are accumulated in 8 bit lanes, so the sequence size must be
+ * lower than 256.
+ *
+ * @param mine Occupancy of the player at the first position of the first window.
+ * @param theirs Occupancy of the opponent at the same position.
+ * @param step Offset between consecutive positions of a window.
+ * @param sequence_size The size of the winning sequence.
+ * @param[out] one_short Bit mask of the windows missing one piece.
+ * @param[out] two_short Bit mask of the windows missing two pieces.
+ */
+void threat_lanes_simd(const uint8_t* mine, const uint8_t* theirs, long step, int sequence_size, uint32_t* one_short, uint32_t* two_short) {
+#if defined(__AVX2__)
+    __m256i mine_count = _mm256_setzero_si256();
+    __m256i theirs_count = _mm256_setzero_si256();
+    for (int k = 0; k < sequence_size; k++) {
+        mine_count = _mm256_add_epi8(mine_count, _mm256_loadu_si256((const __m256i*)(mine + k * step)));
+        theirs_count = _mm256_add_epi8(theirs_count, _mm256_loadu_si256((const __m256i*)(theirs + k * step)));
+    }
+    __m256i open = _mm256_cmpeq_epi8(theirs_count, _mm256_setzero_si256());
+    __m256i one = _mm256_and_si256(open, _mm256_cmpeq_epi8(mine_count, _mm256_set1_epi8((char)(sequence_size - 1))));
+    __m256i two = _mm256_and_si256(open, _mm256_cmpeq_epi8(mine_count, _mm256_set1_epi8((char)(sequence_size - 2))));
+    *one_short = (uint32_t)_mm256_movemask_epi8(one);
+    *two_short = (uint32_t)_mm256_movemask_epi8(two);
+#else
+    __m128i mine_count = _mm_setzero_si128();
+    __m128i theirs_count = _mm_setzero_si128();
+    for (int k = 0; k < sequence_size; k++) {
+        mine_count = _mm_add_epi8(mine_count, _mm_loadu_si128((const __m128i*)(mine + k * step)));
+        theirs_count = _mm_add_epi8(theirs_count, _mm_loadu_si128((const __m128i*)(theirs + k * step)));
+    }
+    __m128i open = _mm_cmpeq_epi8(theirs_count, _mm_setzero_si128());
+    __m128i one = _mm_and_si128(open, _mm_cmpeq_epi8(mine_count, _mm_set1_epi8((char)(sequence_size - 1))));
+    __m128i two = _mm_and_si128(open, _mm_cmpeq_epi8(mine_count, _mm_set1_epi8((char)(sequence_size - 2))));
+    *one_short = (uint32_t)_mm_movemask_epi8(one);
+    *two_short = (uint32_t)_mm_movemask_epi8(two);
+#endif
+}
+#endif
+
+/**
+ * @brief Count the threats of a player in one direction.
+ *
+ * Slides a window of sequence_size positions over the whole board, evaluating
+ * THREAT_LANES consecutive starting columns at once. The occupancy grids are
+ * padded by sequence_size + THREAT_LANES columns on each side, so that every
+ * load stays inside the grid; lanes outside the board are masked out.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param mine Padded occupancy grid of the player.
+ * @param theirs Padded occupancy grid of the opponent.
+ * @param stride The number of columns of a padded row.
+ * @param pad The number of padding columns on each side.
+ * @param direction Index of the direction in THREAT_SHIFTS.
+ * @param[out] threats Pointer to a tThreats structure.
+ */
+void count_threats(pGame game, const uint8_t* mine, const uint8_t* theirs, long stride, int pad, int direction, tThreats* threats) {
+    int l_shift = THREAT_SHIFTS[direction][0];
+    int c_shift = THREAT_SHIFTS[direction][1];
+    int n = game->sequence_size;
+    long step = l_shift * stride + c_shift;
+    // Range of starting positions whose windows fit the board
+    int last_line = game->height - 1 - (n - 1) * l_shift;
+    int first_column = c_shift < 0 ? n - 1 : 0;
+    int last_column = c_shift > 0 ? game->width - n : game->width - 1;
+    for (int l = 0; l <= last_line; l++) {
+        for (int c = first_column; c <= last_column; c += THREAT_LANES) {
+            long offset = l * stride + pad + c;
+            int lanes = last_column - c + 1 < THREAT_LANES ? last_column - c + 1 : THREAT_LANES;
+            uint32_t one_short;
+            uint32_t two_short;
+#if THREAT_LANES > 1
+            if (n < 256) {
+                threat_lanes_simd(mine + offset, theirs + offset, step, n, &one_short, &two_short);
+                uint32_t lane_mask = lanes == 32 ? 0xFFFFFFFFu : (1u << lanes) - 1;
+                one_short &= lane_mask;
+                two_short &= lane_mask;
+            } else
+#endif
+            {
+                threat_lanes_scalar(mine + offset, theirs + offset, step, n, lanes, &one_short, &two_short);
+            }
+            threats->one_short[direction] += __builtin_popcount(one_short);
+            threats->two_short[direction] += __builtin_popcount(two_short);
+        }
+    }
+}
+
+/**
+ * @brief Compute the threat maps of both players of the current game.
+ *
+ * This function allocates, and frees, two padded occupancy grids.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param[out] threats1 Threat map of the first player.
+ * @param[out] threats2 Threat map of the second player.
+ */
+void threat_map(pGame game, tThreats* threats1, tThreats* threats2) {
+    int pad = game->sequence_size + THREAT_LANES;
+    long stride = game->width + 2 * pad;
+    size_t grid_size = (size_t)stride * game->height;
+    uint8_t* grid1 = track_malloc(grid_size);
+    uint8_t* grid2 = track_malloc(grid_size);
+    memset(grid1, 0, grid_size);
+    memset(grid2, 0, grid_size);
+    for (int l = 0; l < game->height; l++) {
+        for (int c = 0; c < game->width; c++) {
+            grid1[l * stride + pad + c] = game->board[l][c] == game->player1;
+            grid2[l * stride + pad + c] = game->board[l][c] == game->player2;
+        }
+    }
+    memset(threats1, 0, sizeof(tThreats));
+    memset(threats2, 0, sizeof(tThreats));
+    for (int direction = 0; direction < 4; direction++) {
+        count_threats(game, grid1, grid2, stride, pad, direction, threats1);
+        count_threats(game, grid2, grid1, stride, pad, direction, threats2);
+    }
+    track_free(grid1);
+    track_free(grid2);
+}
+
+/**
+ * @brief Prints the threat map of a player.
+ *
+ * @param out The output stream.
+ * @param game Pointer to a tGame structure.
+ * @param player Pointer to a tInGamePlayer structure.
+ * @param threats Threat map of the player.
+ */
+void print_threats(FILE* out, pGame game, pInGamePlayer player, tThreats* threats) {
+    fprintf(out, "%s\n", registry_name(&game->registry, player->player));
+    fprintf(out, "1 %d %d %d %d\n", threats->one_short[0], threats->one_short[1], threats->one_short[2], threats->one_short[3]);
+    fprintf(out, "2 %d %d %d %d\n", threats->two_short[0], threats->two_short[1], threats->two_short[2], threats->two_short[3]);
+}
+
+#define TABLEBASE_FILE "tablebase.data"  ///< Tablebase mapped at startup, if it exists.
+#define TABLEBASE_MAGIC "IADETB1"        ///< Identifies a tablebase file (with the terminating null).
+#define TABLEBASE_MAX_SPECIALS 16        ///< Maximum number of special sequences of a tablebase.
+#define TABLEBASE_VALUE_MASK 0xFFull     ///< Low bits of a table entry that hold its value.
+
+/**
+ * @brief Result of a position, for the player to move.
+ */
+enum { RESULT_UNKNOWN, RESULT_WIN, RESULT_LOSS, RESULT_DRAW };
+
+/**
+ * @brief Header of a tablebase file.
+ *
+ * The header is followed by num_slots table entries. Each entry is 0 if the
+ * slot is empty, or the position key with the result in its low bits.
+ */
+typedef struct {
+    char magic[8];                             ///< TABLEBASE_MAGIC.
+    int32_t width;                             ///< The width of the board.
+    int32_t height;                            ///< The height of the board.
+    int32_t sequence_size;                     ///< The size of the winning sequence.
+    int32_t num_specials;                      ///< The number of special sequences of each player.
+    int32_t specials[TABLEBASE_MAX_SPECIALS];  ///< Special sequence sizes of each player, sorted.
+    uint64_t num_slots;                        ///< The number of entries, a power of two.
+    uint64_t num_entries;                      ///< The number of solved positions.
+} tTablebaseHeader;
+
+/**
+ * @brief A hash table of positions.
+ *
+ * Open addressing with linear probing. Each entry is the position key with a
+ * value in the low bits (TABLEBASE_VALUE_MASK), which is never 0.
+ */
+typedef struct {
+    uint64_t* slots;       ///< Array of entries, 0 if empty.
+    uint64_t num_slots;    ///< The number of entries, a power of two.
+    uint64_t num_entries;  ///< The number of used entries.
+} tPositionTable, *pPositionTable;
+
+/**
+ * @brief A position of the solver.
+ *
+ * The board is kept as one byte per cell, with the line 0 at the top, like the
+ * game board. The position maintains the hash of the board and of its mirror
+ * image, which include the player to move and the special sequences left.
+ */
+typedef struct {
+    int width;                                ///< The width of the board.
+    int height;                               ///< The height of the board.
+    int sequence_size;                        ///< The size of the winning sequence.
+    int sizes[TABLEBASE_MAX_SPECIALS];        ///< Distinct special sequence sizes.
+    int initial[TABLEBASE_MAX_SPECIALS];      ///< Initial count of each distinct size.
+    int counts[2][TABLEBASE_MAX_SPECIALS];    ///< Special sequences left to each player.
+    int num_sizes;                            ///< The number of distinct special sequence sizes.
+    uint8_t* cells;                           ///< 0 if empty, 1 or 2 for the first or second player.
+    int* top;                                 ///< First occupied line of each column, height if empty.
+    int empty;                                ///< The number of empty cells.
+    int turn;                                 ///< The player to move, 0 or 1.
+    uint64_t hash;                            ///< Hash of the position.
+    uint64_t mirror_hash;                     ///< Hash of the mirrored position.
+} tPosition, *pPosition;
+
+/**
+ * @brief A move of the solver.
+ */
+typedef struct {
+    int column;    ///< The starting (leftmost) column.
+    int size;      ///< The size of the sequence, 1 for a unit piece.
+    int size_idx;  ///< Index of the special sequence size, -1 for a unit piece.
+} tMove;
+
+/**
+ * @brief The solver state.
+ */
+typedef struct {
+    tPositionTable results;   ///< Solved positions, with their results.
+    tPositionTable searched;  ///< Unsolved positions, with the depth searched plus one.
+    uint64_t seed;            ///< State of the random playouts.
+    atomic_bool* stop;        ///< Aborts the search when set, or NULL.
+} tSolver, *pSolver;
+
+/**
+ * @brief The mapped tablebase.
+ */
+typedef struct {
+    const tTablebaseHeader* header;  ///< Header of the mapped file, or NULL.
+    const uint64_t* slots;           ///< Table entries of the mapped file.
+    size_t length;                   ///< The length of the mapping.
+} tTablebase;
+
+static tTablebase tablebase;  ///< The tablebase mapped at startup.
+
+/**
+ * @brief The splitmix64 mixing function.
+ *
+ * @param x The value to mix.
+ * @return uint64_t The mixed value.
+ */
+uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+/**
+ * @brief Comparison function for sorting sequence sizes.
+ *
+ * @param i1 Pointer to the first int.
+ * @param i2 Pointer to the second int.
+ * @return int Negative if the first is smaller, positive if greater, 0 if equal.
+ */
+int comp_int(const void* i1, const void* i2) {
+    return *(const int*)i1 - *(const int*)i2;
+}
+
+/**
+ * @brief Get a Zobrist key.
+ *
+ * Keys are computed by mixing their coordinates, so no key table is stored, and
+ * the generator and the queries always agree.
+ *
+ * @param kind 1 for cells, 2 for the player to move, 3 for special sequences.
+ * @param index The cell, or the player and size index.
+ * @param value The piece, or the special sequence count.
+ * @return uint64_t The key.
+ */
+uint64_t zobrist(uint64_t kind, uint64_t index, uint64_t value) {
+    return splitmix64(kind << 56 ^ index << 24 ^ value);
+}
+
+/**
+ * @brief Initialize a position with an empty board.
+ *
+ * @param pos Pointer to a tPosition structure.
+ * @param width The width of the board.
+ * @param height The height of the board.
+ * @param sequence_size The size of the winning sequence.
+ * @param specials Special sequence sizes of each player.
+ * @param num_specials The number of special sequences.
+ */
+void position_init(pPosition pos, int width, int height, int sequence_size, const int* specials, int num_specials) {
+    pos->width = width;
+    pos->height = height;
+    pos->sequence_size = sequence_size;
+    pos->num_sizes = 0;
+    for (int i = 0; i < num_specials; i++) {
+        int j = 0;
+        while (j < pos->num_sizes && pos->sizes[j] != specials[i]) j++;
+        if (j == pos->num_sizes) {
+            pos->sizes[pos->num_sizes] = specials[i];
+            pos->initial[pos->num_sizes++] = 0;
+        }
+        pos->initial[j]++;
+    }
+    pos->cells = track_malloc(width * height);
+    pos->top = track_malloc(sizeof(int) * width);
+    memset(pos->cells, 0, width * height);
+    for (int c = 0; c < width; c++) {
+        pos->top[c] = height;
+    }
+    pos->empty = width * height;
+    pos->turn = 0;
+    pos->hash = 0;
+    for (int p = 0; p < 2; p++) {
+        for (int i = 0; i < pos->num_sizes; i++) {
+            pos->counts[p][i] = pos->initial[i];
+            pos->hash ^= zobrist(3, p * TABLEBASE_MAX_SPECIALS + i, pos->counts[p][i]);
+        }
+    }
+    pos->mirror_hash = pos->hash;
+}
+
+/**
+ * @brief Free a position.
+ *
+ * @param pos Pointer to a tPosition structure.
+ */
+void position_free(pPosition pos) {
+    track_free(pos->cells);
+    track_free(pos->top);
+}
+
+/**
+ * @brief Set or clear a cell, updating the hashes.
+ *
+ * @param pos Pointer to a tPosition structure.
+ * @param line The line of the cell.
+ * @param column The column of the cell.
+ * @param piece The new piece, 0 to clear the cell.
+ */
+void position_set_cell(pPosition pos, int line, int column, int piece) {
+    uint8_t* cell = &pos->cells[line * pos->width + column];
+    int mirror_column = pos->width - 1 - column;
+    int piece_in_hash = *cell != 0 ? *cell : piece;
+    pos->hash ^= zobrist(1, line * pos->width + column, piece_in_hash);
+    pos->mirror_hash ^= zobrist(1, line * pos->width + mirror_column, piece_in_hash);
+    pos->empty += piece == 0 ? 1 : -1;
+    *cell = piece;
+}
+
+/**
+ * @brief Set the special sequence count of a player, updating the hashes.
+ *
+ * @param pos Pointer to a tPosition structure.
+ * @param player The player, 0 or 1.
+ * @param size_idx Index of the special sequence size.
+ * @param count The new count.
+ */
+void position_set_count(pPosition pos, int player, int size_idx, int count) {
+    uint64_t key = zobrist(3, player * TABLEBASE_MAX_SPECIALS + size_idx, pos->counts[player][size_idx]);
+    key ^= zobrist(3, player * TABLEBASE_MAX_SPECIALS + size_idx, count);
+    pos->hash ^= key;
+    pos->mirror_hash ^= key;
+    pos->counts[player][size_idx] = count;
+}
+
+/**
+ * @brief Change the player to move, updating the hashes.
+ *
+ * @param pos Pointer to a tPosition structure.
+ */
+void position_toggle_turn(pPosition pos) {
+    pos->turn ^= 1;
+    pos->hash ^= zobrist(2, 0, 0);
+    pos->mirror_hash ^= zobrist(2, 0, 0);
+}
+
+/**
+ * @brief Get the canonical key of a position.
+ *
+ * A position and its mirror image have the same result, so both share the
+ * smallest of their hashes.
+ *
+ * @param pos Pointer to a tPosition structure.
+ * @return uint64_t The canonical key.
+ */
+uint64_t position_key(pPosition pos) {
+    return pos->hash < pos->mirror_hash ? pos->hash : pos->mirror_hash;
+}
+
+/**
+ * @brief Check if the piece in a cell completes a sequence.
+ *
+ * @param pos Pointer to a tPosition structure.
+ * @param line The line of the cell.
+ * @param column The column of the cell.
+ * @return bool True if the piece is part of a winning sequence.
+ */
+bool position_wins(pPosition pos, int line, int column) {
+    int piece = pos->cells[line * pos->width + column];
+    for (int direction = 0; direction < 4; direction++) {
+        int count = 1;
+        for (int sign = -1; sign <= 1; sign += 2) {
+            int l = line + sign * THREAT_SHIFTS[direction][0];
+            int c = column + sign * THREAT_SHIFTS[direction][1];
+            while (l >= 0 && l < pos->height && c >= 0 && c < pos->width && pos->cells[l * pos->width + c] == piece) {
+                count++;
+                l += sign * THREAT_SHIFTS[direction][0];
+                c += sign * THREAT_SHIFTS[direction][1];
+            }
+        }
+        if (count >= pos->sequence_size) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Get the legal moves of the player to move.
+ *
+ * Unit pieces are listed first, from the center columns outwards, to find wins
+ * early. A special sequence is listed once per starting column.
+ *
+ * @param pos Pointer to a tPosition structure.
+ * @param[out] moves Array with room for width * (num_sizes + 1) moves.
+ * @return int The number of moves.
+ */
+int position_moves(pPosition pos, tMove* moves) {
+    int num_moves = 0;
+    for (int i = 0; i < pos->width; i++) {
+        int c = pos->width / 2 + (i % 2 == 0 ? i / 2 : -(i / 2 + 1));
+        if (c >= 0 && c < pos->width && pos->top[c] > 0) {
+            moves[num_moves++] = (tMove){c, 1, -1};
+        }
+    }
+    for (int s = 0; s < pos->num_sizes; s++) {
+        if (pos->counts[pos->turn][s] == 0) continue;
+        int open = 0;
+        for (int c = 0; c < pos->width; c++) {
+            open = pos->top[c] > 0 ? open + 1 : 0;
+            if (open >= pos->sizes[s]) {
+                moves[num_moves++] = (tMove){c - pos->sizes[s] + 1, pos->sizes[s], s};
+            }
+        }
+    }
+    return num_moves;
+}
+
+/**
+ * @brief Play a move.
+ *
+ * @param pos Pointer to a tPosition structure.
+ * @param move The move to play.
+ * @return bool True if the move wins the game.
+ */
+bool position_play(pPosition pos, tMove move) {
+    int piece = pos->turn + 1;
+    bool wins = false;
+    for (int c = move.column; c < move.column + move.size; c++) {
+        position_set_cell(pos, --pos->top[c], c, piece);
+    }
+    for (int c = move.column; c < move.column + move.size && !wins; c++) {
+        wins = position_wins(pos, pos->top[c], c);
+    }
+    if (move.size_idx >= 0) {
+        position_set_count(pos, pos->turn, move.size_idx, pos->counts[pos->turn][move.size_idx] - 1);
+    }
+    position_toggle_turn(pos);
+    return wins;
+}
+
+/**
+ * @brief Undo a move.
+ *
+ * @param pos Pointer to a tPosition structure.
+ * @param move The last move played.
+ */
+void position_undo(pPosition pos, tMove move) {
+    position_toggle_turn(pos);
+    if (move.size_idx >= 0) {
+        position_set_count(pos, pos->turn, move.size_idx, pos->counts[pos->turn][move.size_idx] + 1);
+    }
+    for (int c = move.column; c < move.column + move.size; c++) {
+        position_set_cell(pos, pos->top[c]++, c, 0);
+    }
+}
+
+/**
+ * @brief Initialize a position table.
+ *
+ * @param table Pointer to a tPositionTable structure.
+ * @param num_slots The initial number of entries, a power of two.
+ */
+void position_table_init(pPositionTable table, uint64_t num_slots) {
+    table->slots = track_malloc(sizeof(uint64_t) * num_slots);
+    memset(table->slots, 0, sizeof(uint64_t) * num_slots);
+    table->num_slots = num_slots;
+    table->num_entries = 0;
+}
+
+/**
+ * @brief Look up a position.
+ *
+ * Shared by the solver tables and the mapped tablebase.
+ *
+ * @param slots Array of entries.
+ * @param num_slots The number of entries, a power of two.
+ * @param key The position key.
+ * @return int The value of the position, 0 if not found.
+ */
+int position_table_get(const uint64_t* slots, uint64_t num_slots, uint64_t key) {
+    key &= ~TABLEBASE_VALUE_MASK;
+    for (uint64_t i = splitmix64(key) & (num_slots - 1);; i = (i + 1) & (num_slots - 1)) {
+        if (slots[i] == 0) return 0;
+        if ((slots[i] & ~TABLEBASE_VALUE_MASK) == key) return slots[i] & TABLEBASE_VALUE_MASK;
+    }
+}
+
+/**
+ * @brief Insert or update a position.
+ *
+ * The table doubles its size when it becomes half full.
+ *
+ * @param table Pointer to a tPositionTable structure.
+ * @param key The position key.
+ * @param value The value of the position, between 1 and 255.
+ */
+void position_table_put(pPositionTable table, uint64_t key, int value) {
+    if (2 * (table->num_entries + 1) > table->num_slots) {
+        tPositionTable grown;
+        position_table_init(&grown, table->num_slots * 2);
+        for (uint64_t i = 0; i < table->num_slots; i++) {
+            if (table->slots[i] != 0) {
+                position_table_put(&grown, table->slots[i], table->slots[i] & TABLEBASE_VALUE_MASK);
+            }
+        }
+        track_free(table->slots);
+        *table = grown;
+    }
+    key &= ~TABLEBASE_VALUE_MASK;
+    uint64_t i = splitmix64(key) & (table->num_slots - 1);
+    while (table->slots[i] != 0 && (table->slots[i] & ~TABLEBASE_VALUE_MASK) != key) {
+        i = (i + 1) & (table->num_slots - 1);
+    }
+    if (table->slots[i] == 0) {
+        table->num_entries++;
+    }
+    table->slots[i] = key | (uint64_t)value;
+}
+
+/**
+ * @brief Solve a position with a bounded search.
+ *
+ * Negamax on win, loss and draw. The result is exact unless it is
+ * RESULT_UNKNOWN, which means the horizon was reached first. Since every move
+ * fills at least one cell, a depth not less than the number of empty cells
+ * always gives an exact result.
+ *
+ * Once solver->stop is set, the search unwinds with RESULT_UNKNOWN, without
+ * recording the positions it did not finish.
+ *
+ * @param solver Pointer to a tSolver structure.
+ * @param pos Pointer to a tPosition structure.
+ * @param depth The number of moves to search.
+ * @return int The result for the player to move.
+ */
+int solve(pSolver solver, pPosition pos, int depth) {
+    if (pos->empty == 0) return RESULT_DRAW;
+    if (solver->stop != NULL && atomic_load_explicit(solver->stop, memory_order_relaxed)) return RESULT_UNKNOWN;
+    uint64_t key = position_key(pos);
+    int result = position_table_get(solver->results.slots, solver->results.num_slots, key);
+    if (result != RESULT_UNKNOWN) return result;
+    if (depth == 0 || position_table_get(solver->searched.slots, solver->searched.num_slots, key) > depth) {
+        return RESULT_UNKNOWN;
+    }
+
+    tMove* moves = track_malloc(sizeof(tMove) * pos->width * (pos->num_sizes + 1));
+    int num_moves = position_moves(pos, moves);
+    bool unknown = false;
+    bool draw = false;
+    result = RESULT_LOSS;
+    for (int i = 0; i < num_moves && result != RESULT_WIN; i++) {
+        if (position_play(pos, moves[i])) {
+            result = RESULT_WIN;
+        } else {
+            int child = solve(solver, pos, depth - 1);
+            result = child == RESULT_LOSS ? RESULT_WIN : result;
+            unknown |= child == RESULT_UNKNOWN;
+            draw |= child == RESULT_DRAW;
+        }
+        position_undo(pos, moves[i]);
+    }
+    track_free(moves);
+
+    if (result != RESULT_WIN) {
+        result = unknown ? RESULT_UNKNOWN : draw ? RESULT_DRAW : RESULT_LOSS;
+    }
+    if (result != RESULT_UNKNOWN) {
+        position_table_put(&solver->results, key, result);
+    } else if (solver->stop == NULL || !atomic_load_explicit(solver->stop, memory_order_relaxed)) {
+        position_table_put(&solver->searched, key, depth < 254 ? depth + 1 : 255);
+    }
+    return result;
+}
+
+/**
+ * @brief Solve all the positions of the opening.
+ *
+ * @param solver Pointer to a tSolver structure.
+ * @param pos Pointer to a tPosition structure.
+ * @param plies The number of moves left to enumerate.
+ * @param horizon The search depth of each position.
+ */
+void solve_openings(pSolver solver, pPosition pos, int plies, int horizon) {
+    solve(solver, pos, horizon);
+    if (plies == 0) return;
+    tMove* moves = track_malloc(sizeof(tMove) * pos->width * (pos->num_sizes + 1));
+    int num_moves = position_moves(pos, moves);
+    for (int i = 0; i < num_moves; i++) {
+        if (!position_play(pos, moves[i])) {
+            solve_openings(solver, pos, plies - 1, horizon);
+        }
+        position_undo(pos, moves[i]);
+    }
+    track_free(moves);
+}
+
+/**
+ * @brief Solve endgame positions reached by random games.
+ *
+ * Each game is played at random until at most horizon cells are empty, and
+ * that position is then solved exactly.
+ *
+ * @param solver Pointer to a tSolver structure.
+ * @param pos Pointer to a tPosition structure with an empty board.
+ * @param horizon The number of empty cells of the endgame positions.
+ * @param games The number of random games.
+ */
+void solve_endgames(pSolver solver, pPosition pos, int horizon, long games) {
+    int max_moves = pos->width * pos->height;
+    tMove* moves = track_malloc(sizeof(tMove) * pos->width * (pos->num_sizes + 1));
+    tMove* played = track_malloc(sizeof(tMove) * max_moves);
+    for (long g = 0; g < games; g++) {
+        int num_played = 0;
+        bool over = false;
+        while (!over && pos->empty > horizon) {
+            int num_moves = position_moves(pos, moves);
+            solver->seed = splitmix64(solver->seed);
+            played[num_played] = moves[solver->seed % num_moves];
+            over = position_play(pos, played[num_played++]);
+        }
+        if (!over) {
+            solve(solver, pos, horizon);
+        }
+        while (num_played > 0) {
+            position_undo(pos, played[--num_played]);
+        }
+    }
+    track_free(moves);
+    track_free(played);
+}
+
+/**
+ * @brief Generate a tablebase file.
+ *
+ * Usage: -t Ficheiro Comprimento Altura TamanhoSequência Abertura Horizonte
+ * Jogos [TamanhoPeça ...]. Solves every position up to Abertura moves, and the
+ * endgames of Jogos random games, with a search depth of Horizonte moves. Only
+ * exact results are written.
+ *
+ * @param argc The number of arguments after -t.
+ * @param argv The arguments after -t.
+ * @return int 0 on success, 1 otherwise.
+ */
+int generate_tablebase(int argc, char** argv) {
+    if (argc < 7 || argc - 7 > TABLEBASE_MAX_SPECIALS) {
+        fprintf(stderr, "Instrução inválida.\n");
+        return 1;
+    }
+    tTablebaseHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TABLEBASE_MAGIC, sizeof(header.magic));
+    header.width = atoi(argv[1]);
+    header.height = atoi(argv[2]);
+    header.sequence_size = atoi(argv[3]);
+    header.num_specials = argc - 7;
+    int specials[TABLEBASE_MAX_SPECIALS];
+    for (int i = 0; i < header.num_specials; i++) {
+        specials[i] = atoi(argv[7 + i]);
+    }
+    qsort(specials, header.num_specials, sizeof(int), comp_int);
+    if (header.width <= 0 || header.height <= 0 || !valid_dimensions(header.width, header.height)) {
+        fprintf(stderr, "Dimensões de grelha inválidas.\n");
+        return 1;
+    }
+    if (header.sequence_size <= 0 || !valid_sequence(header.width, header.sequence_size)) {
+        fprintf(stderr, "Tamanho de sequência inválido.\n");
+        return 1;
+    }
+    for (int i = 0; i < header.num_specials; i++) {
+        if (specials[i] <= 1 || specials[i] >= header.sequence_size) {
+            fprintf(stderr, "Dimensões de peças especiais inválidas.\n");
+            return 1;
+        }
+        header.specials[i] = specials[i];
+    }
+
+    tSolver solver;
+    tPosition pos;
+    position_table_init(&solver.results, 1024);
+    position_table_init(&solver.searched, 1024);
+    solver.seed = 0;
+    solver.stop = NULL;
+    position_init(&pos, header.width, header.height, header.sequence_size, specials, header.num_specials);
+    solve_openings(&solver, &pos, atoi(argv[4]), atoi(argv[5]));
+    solve_endgames(&solver, &pos, atoi(argv[5]), atol(argv[6]));
+    header.num_slots = solver.results.num_slots;
+    header.num_entries = solver.results.num_entries;
+
+    FILE* fp = fopen(argv[0], "wb");
+    bool written = fp != NULL && fwrite(&header, sizeof(header), 1, fp) == 1 &&
+                   fwrite(solver.results.slots, sizeof(uint64_t), header.num_slots, fp) == header.num_slots;
+    if (fp != NULL && fclose(fp) != 0) {
+        written = false;
+    }
+    if (written) {
+        printf("Tabela gravada com %lu posições.\n", (unsigned long)header.num_entries);
+    } else {
+        fprintf(stderr, "Ocorreu um erro ao gravar a tabela.\n");
+    }
+    position_free(&pos);
+    track_free(solver.results.slots);
+    track_free(solver.searched.slots);
+    return written ? 0 : 1;
+}
+
+/**
+ * @brief Map a tablebase file, if it exists and is valid.
+ *
+ * @param table Pointer to a tTablebase structure, with nothing mapped.
+ * @param filename The name of the file.
+ * @return true If the file was mapped.
+ */
+bool map_tablebase(tTablebase* table, char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(tTablebaseHeader)) {
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED) {
+            const tTablebaseHeader* header = data;
+            uint64_t n = header->num_slots;
+            bool valid = memcmp(header->magic, TABLEBASE_MAGIC, sizeof(header->magic)) == 0 &&
+                         n > 0 && (n & (n - 1)) == 0 && header->num_entries < n &&
+                         header->num_specials >= 0 && header->num_specials <= TABLEBASE_MAX_SPECIALS &&
+                         (size_t)st.st_size == sizeof(tTablebaseHeader) + n * sizeof(uint64_t);
+            if (valid) {
+                table->header = header;
+                table->slots = (const uint64_t*)(header + 1);
+                table->length = st.st_size;
+            } else {
+                munmap(data, st.st_size);
+            }
+        }
+    }
+    close(fd);
+    return table->header != NULL;
+}
+
+/**
+ * @brief Unmap a tablebase.
+ *
+ * @param table Pointer to a tTablebase structure.
+ */
+void unmap_tablebase(tTablebase* table) {
+    if (table->header != NULL) {
+        munmap((void*)table->header, table->length);
+        table->header = NULL;
+    }
+}
+
+/**
+ * @brief Look up the current game in a tablebase.
+ *
+ * @param table Pointer to a tTablebase structure.
+ * @param game Pointer to a tGame structure.
+ * @param player Pointer to the tInGamePlayer to move.
+ * @return int The result for the player, or -1 if the tablebase does not match
+ * the game.
+ */
+int query_tablebase(const tTablebase* table, pGame game, pInGamePlayer player) {
+    const tTablebaseHeader* header = table->header;
+    if (header == NULL || header->width != game->width || header->height != game->height ||
+        header->sequence_size != game->sequence_size) {
+        return -1;
+    }
+    // Sizes below 2 (e.g., from an empty special sequence line) can never be played
+    int specials[TABLEBASE_MAX_SPECIALS];
+    int num_specials = 0;
+    for (int i = 0; i < game->num_special_sequences; i++) {
+        if (game->special_sequences[i] > 1) {
+            if (num_specials == header->num_specials) return -1;
+            specials[num_specials++] = game->special_sequences[i];
+        }
+    }
+    if (num_specials != header->num_specials) return -1;
+    qsort(specials, num_specials, sizeof(int), comp_int);
+    for (int i = 0; i < num_specials; i++) {
+        if (specials[i] != header->specials[i]) return -1;
+    }
+
+    tPosition pos;
+    position_init(&pos, game->width, game->height, game->sequence_size, specials, num_specials);
+    for (int l = 0; l < game->height; l++) {
+        for (int c = 0; c < game->width; c++) {
+            if (game->board[l][c] != NULL) {
+                position_set_cell(&pos, l, c, game->board[l][c] == game->player1 ? 1 : 2);
+            }
+        }
+    }
+    pInGamePlayer players[2] = {game->player1, game->player2};
+    for (int p = 0; p < 2; p++) {
+        for (int i = 0; i < pos.num_sizes; i++) {
+            int count = 0;
+            for (int j = 0; j < players[p]->num_special_sequences; j++) {
+                count += players[p]->special_sequences[j] == pos.sizes[i];
+            }
+            position_set_count(&pos, p, i, count);
+        }
+    }
+    if (player == game->player2) {
+        position_toggle_turn(&pos);
+    }
+    int result = position_table_get(table->slots, header->num_slots, position_key(&pos));
+    position_free(&pos);
+    return result;
+}
+
+/**
+ * @brief A match of a tournament.
+ */
+typedef struct {
+    int first;   ///< Index of the player that moves first, in the registry arrays.
+    int second;  ///< Index of the player that moves second.
+    int result;  ///< 1 or 2 if the first or second player wins, 0 for a draw.
+} tMatch;
+
+/**
+ * @brief A batch of tournament matches, shared by the tournament threads.
+ *
+ * Each thread plays matches on its own board, so the threads only share the
+ * index of the next match.
+ */
+typedef struct {
+    tMatch* matches;            ///< The matches to play.
+    long num_matches;           ///< The number of matches.
+    atomic_long next;           ///< Index of the next match to play.
+    int width;                  ///< The width of the boards.
+    int height;                 ///< The height of the boards.
+    int sequence_size;          ///< The size of the winning sequence.
+    int* special_sequences;     ///< Special sequence sizes of each player.
+    int num_special_sequences;  ///< The number of special sequences.
+    char bot;                   ///< The bot that plays every match, 'A' or 'G'.
+    uint64_t seed;              ///< Seed of the random choices of the bots.
+    tMemTracker* tracker;       ///< The tracker of the thread that runs the tournament.
+} tTournament, *pTournament;
+
+/**
+ * @brief Check if the player to move would win by dropping a unit piece.
+ *
+ * @param pos Pointer to a tPosition structure.
+ * @param column The column of the piece.
+ * @return bool True if the piece wins the game.
+ */
+bool bot_unit_wins(pPosition pos, int column) {
+    tMove move = {column, 1, -1};
+    bool wins = position_play(pos, move);
+    position_undo(pos, move);
+    return wins;
+}
+
+/**
+ * @brief Choose the move of a bot.
+ *
+ * The random bot ('A') plays any legal move. The greedy bot ('G') wins if it
+ * can, blocks the unit piece that would make the opponent win otherwise, and
+ * plays at random if neither applies.
+ *
+ * @param pos Pointer to a tPosition structure.
+ * @param moves The legal moves.
+ * @param num_moves The number of legal moves, at least 1.
+ * @param bot The bot, 'A' or 'G'.
+ * @param seed Pointer to the state of the random choices.
+ * @return tMove The chosen move.
+ */
+tMove bot_move(pPosition pos, tMove* moves, int num_moves, char bot, uint64_t* seed) {
+    if (bot == 'G') {
+        for (int i = 0; i < num_moves; i++) {
+            bool wins = position_play(pos, moves[i]);
+            position_undo(pos, moves[i]);
+            if (wins) return moves[i];
+        }
+        position_toggle_turn(pos);
+        int block = -1;
+        for (int c = 0; c < pos->width && block == -1; c++) {
+            if (pos->top[c] > 0 && bot_unit_wins(pos, c)) {
+                block = c;
+            }
+        }
+        position_toggle_turn(pos);
+        if (block != -1) {
+            return (tMove){block, 1, -1};
+        }
+    }
+    *seed = splitmix64(*seed);
+    return moves[*seed % num_moves];
+}
+
+/**
+ * @brief Play a match between two bots.
+ *
+ * The win of a completed sequence goes to the player that completed it, as in
+ * CP. The position is restored to its initial state at the end of the match.
+ *
+ * @param pos Pointer to a tPosition structure with an empty board.
+ * @param moves Array with room for the legal moves of any position.
+ * @param played Array with room for one move per cell.
+ * @param bot The bot, 'A' or 'G'.
+ * @param seed The seed of the random choices.
+ * @return int 1 or 2 if the first or second player wins, 0 for a draw.
+ */
+int play_match(pPosition pos, tMove* moves, tMove* played, char bot, uint64_t seed) {
+    int num_played = 0;
+    int result = 0;
+    while (result == 0 && pos->empty > 0) {
+        int num_moves = position_moves(pos, moves);
+        int mover = pos->turn;
+        played[num_played] = bot_move(pos, moves, num_moves, bot, &seed);
+        if (position_play(pos, played[num_played++])) {
+            result = mover + 1;
+        }
+    }
+    while (num_played > 0) {
+        position_undo(pos, played[--num_played]);
+    }
+    return result;
+}
+
+/**
+ * @brief Main function of a tournament thread.
+ *
+ * Plays matches until there are none left. The seed of each match depends
+ * only on its index, so the results do not depend on the number of threads.
+ *
+ * @param arg Pointer to a tTournament structure.
+ * @return void* NULL.
+ */
+void* tournament_main(void* arg) {
+    pTournament tournament = arg;
+    mem_use_tracker(tournament->tracker);
+    mem_set_command("XJ");
+    tPosition pos;
+    position_init(&pos, tournament->width, tournament->height, tournament->sequence_size, tournament->special_sequences, tournament->num_special_sequences);
+    tMove* moves = track_malloc(sizeof(tMove) * pos.width * (pos.num_sizes + 1));
+    tMove* played = track_malloc(sizeof(tMove) * pos.width * pos.height);
+    long idx;
+    while ((idx = atomic_fetch_add(&tournament->next, 1)) < tournament->num_matches) {
+        uint64_t seed = splitmix64(tournament->seed + idx);
+        tournament->matches[idx].result = play_match(&pos, moves, played, tournament->bot, seed);
+    }
+    track_free(moves);
+    track_free(played);
+    position_free(&pos);
+    return NULL;
+}
+
+/**
+ * @brief Play a set of matches on a pool of threads.
+ *
+ * @param tournament Pointer to a tTournament structure.
+ * @param matches The matches to play.
+ * @param num_matches The number of matches.
+ * @param num_threads The number of threads.
+ */
+void play_matches(pTournament tournament, tMatch* matches, long num_matches, int num_threads) {
+    tournament->matches = matches;
+    tournament->num_matches = num_matches;
+    atomic_init(&tournament->next, 0);
+    tournament->tracker = mem_get_tracker();
+    if (num_threads > num_matches) num_threads = (int)num_matches;
+    if (num_threads < 1) num_threads = 1;
+    pthread_t* threads = track_malloc(sizeof(pthread_t) * num_threads);
+    for (int i = 0; i < num_threads; i++) {
+        pthread_create(&threads[i], NULL, tournament_main, tournament);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    track_free(threads);
+    tournament->seed += num_matches;
+}
+
+/**
+ * @brief Accumulate the results of a set of matches.
+ *
+ * @param matches The played matches.
+ * @param num_matches The number of matches.
+ * @param[in,out] games_played Games played by each player.
+ * @param[in,out] wins Wins of each player.
+ * @param[in,out] points Points of each player, 2 per win and 1 per draw.
+ */
+void count_matches(tMatch* matches, long num_matches, int* games_played, int* wins, int* points) {
+    for (long i = 0; i < num_matches; i++) {
+        games_played[matches[i].first]++;
+        games_played[matches[i].second]++;
+        if (matches[i].result == 0) {
+            points[matches[i].first]++;
+            points[matches[i].second]++;
+        } else {
+            int winner = matches[i].result == 1 ? matches[i].first : matches[i].second;
+            wins[winner]++;
+            points[winner] += 2;
+        }
+    }
+}
+
+/**
+ * @brief Pair the players of a Swiss round.
+ *
+ * Players are sorted by points, and each one is paired with the next unpaired
+ * player it has not met yet, or with the next unpaired player if it has met
+ * them all. With an odd number of players, the last one is left out.
+ *
+ * @param points Points of each player.
+ * @param num_players The number of players.
+ * @param opponents Opponents of each player, rounds entries per player.
+ * @param round The index of the round.
+ * @param rounds The number of rounds.
+ * @param[out] matches Array with room for num_players / 2 matches.
+ * @return int The number of matches.
+ */
+int pair_swiss_round(int* points, int num_players, int* opponents, int round, int rounds, tMatch* matches) {
+    int* order = track_malloc(sizeof(int) * num_players);
+    bool* paired = track_malloc(sizeof(bool) * num_players);
+    for (int i = 0; i < num_players; i++) {
+        order[i] = i;
+        paired[i] = false;
+    }
+    // Insertion sort keeps equal points in registration order
+    for (int i = 1; i < num_players; i++) {
+        int p = order[i];
+        int j = i;
+        for (; j > 0 && points[order[j - 1]] < points[p]; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = p;
+    }
+    int num_matches = 0;
+    for (int i = 0; i < num_players; i++) {
+        int p = order[i];
+        if (paired[p]) continue;
+        int pick = -1;
+        for (int j = i + 1; j < num_players && pick == -1; j++) {
+            int q = order[j];
+            bool met = false;
+            for (int r = 0; r < round && !met; r++) {
+                met = opponents[p * rounds + r] == q;
+            }
+            pick = !paired[q] && !met ? q : -1;
+        }
+        for (int j = i + 1; j < num_players && pick == -1; j++) {
+            pick = !paired[order[j]] ? order[j] : -1;
+        }
+        if (pick == -1) break;
+        paired[p] = paired[pick] = true;
+        opponents[p * rounds + round] = pick;
+        opponents[pick * rounds + round] = p;
+        matches[num_matches++] = round % 2 == 0 ? (tMatch){p, pick, 0} : (tMatch){pick, p, 0};
+    }
+    track_free(order);
+    track_free(paired);
+    return num_matches;
+}
+
+/**
+ * @brief Run a tournament among all the registered players.
+ *
+ * In a round-robin tournament ('T'), every pair of players meets once per
+ * round, alternating the first player. In a Swiss tournament ('S'), each round
+ * pairs players with similar points. The matches of each round are played
+ * concurrently, and the records of the players are updated at the end, as
+ * game_over does.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param format The format, 'T' or 'S'.
+ * @param rounds The number of rounds.
+ * @param tournament Pointer to a tTournament structure with the board and bot.
+ * @param num_threads The number of threads.
+ * @return long The number of games played.
+ */
+long run_tournament(pGame game, char format, int rounds, pTournament tournament, int num_threads) {
+    pRegistry registry = &game->registry;
+    int n = registry->num_players;
+    int* games_played = track_malloc(sizeof(int) * n);
+    int* wins = track_malloc(sizeof(int) * n);
+    int* points = track_malloc(sizeof(int) * n);
+    memset(games_played, 0, sizeof(int) * n);
+    memset(wins, 0, sizeof(int) * n);
+    memset(points, 0, sizeof(int) * n);
+    tournament->seed = 0;
+    long num_games = 0;
+    if (format == 'T') {
+        tMatch* matches = track_malloc(sizeof(tMatch) * ((size_t)n * (n - 1) / 2));
+        for (int r = 0; r < rounds; r++) {
+            long num_matches = 0;
+            for (int i = 0; i < n; i++) {
+                for (int j = i + 1; j < n; j++) {
+                    matches[num_matches++] = (r + i + j) % 2 == 0 ? (tMatch){i, j, 0} : (tMatch){j, i, 0};
+                }
+            }
+            play_matches(tournament, matches, num_matches, num_threads);
+            count_matches(matches, num_matches, games_played, wins, points);
+            num_games += num_matches;
+        }
+        track_free(matches);
+    } else {
+        tMatch* matches = track_malloc(sizeof(tMatch) * (n / 2));
+        int* opponents = track_malloc(sizeof(int) * n * rounds);
+        for (int r = 0; r < rounds; r++) {
+            int num_matches = pair_swiss_round(points, n, opponents, r, rounds, matches);
+            play_matches(tournament, matches, num_matches, num_threads);
+            count_matches(matches, num_matches, games_played, wins, points);
+            num_games += num_matches;
+        }
+        track_free(matches);
+        track_free(opponents);
+    }
+
+    for (int i = 0; i < n; i++) {
+        if (games_played[i] > 0) {
+            int player = registry->ids[i];
+            rankings_remove(game, player);
+            registry->games_played[i] += games_played[i];
+            registry->wins[i] += wins[i];
+            rankings_insert(game, player);
+            publish_player_records(game, player);
+        }
+    }
+    track_free(games_played);
+    track_free(wins);
+    track_free(points);
+    return num_games;
+}
+
+#define ARCHIVE_BLOCK_GAMES 64  ///< The number of games of a full archive block.
+#define ARCHIVE_MAGIC "IAB1"    ///< Identifies an archive block.
+
+/**
+ * @brief Columns of an archive block.
+ *
+ * - NAMES: the names of the players of the block, as a length and the bytes.
+ * - PLAYERS: for each game, the name indices of the first and second players.
+ * - RESULTS: for each game, the result (0 for a draw, 1 or 2 for a win of the
+ *   first or second player) and the number of moves.
+ * - CONFIGS: for each game, the width, height, sequence size, the number of
+ *   special sequences and their sizes.
+ * - MOVES: for each game, the byte length of its move log, then the move log.
+ *   Each move is (size << 1 | player), followed by the line and column of
+ *   each piece, as computed by drop.
+ *
+ * All the integers are variable-length integers (see buffer_put_varint).
+ */
+enum { ARCHIVE_NAMES, ARCHIVE_PLAYERS, ARCHIVE_RESULTS, ARCHIVE_CONFIGS, ARCHIVE_MOVES, ARCHIVE_NUM_COLUMNS };
+
+/**
+ * @brief Header of an archive block.
+ *
+ * The header is followed by the columns, in order.
+ */
+typedef struct {
+    char magic[4];                           ///< ARCHIVE_MAGIC, without the terminating null.
+    uint32_t num_games;                      ///< The number of games of the block.
+    uint32_t sizes[ARCHIVE_NUM_COLUMNS];     ///< The number of bytes of each column.
+} tArchiveBlockHeader;
+
+/**
+ * @brief A view of the columns of an archive block.
+ */
+typedef struct {
+    const uint8_t* columns[ARCHIVE_NUM_COLUMNS];  ///< The columns.
+    uint32_t sizes[ARCHIVE_NUM_COLUMNS];          ///< The number of bytes of each column.
+    uint32_t num_games;                           ///< The number of games of the block.
+    long first_game;                              ///< The number of the first game of the block.
+} tArchiveBlock, *pArchiveBlock;
+
+/**
+ * @brief The blocks that include the games of a player.
+ */
+typedef struct {
+    char* name;   ///< The name of the player.
+    int* blocks;  ///< Indices of the blocks, in increasing order.
+    int num_blocks;  ///< The number of blocks.
+} tArchiveIndexEntry;
+
+/**
+ * @brief An append-only archive of finished games.
+ *
+ * Games are gathered in a pending block, which is written after the blocks of
+ * the file as each game finishes, over its previous partial copy, and becomes
+ * a block of the file when it is full. The file is memory-mapped, and queries
+ * read the mapped blocks and the pending block alike. Without a file, the
+ * blocks are kept in memory for the session only.
+ *
+ * The per-player index is built by reading only the NAMES column of each
+ * block when the archive is mapped, and updated as games are added.
+ */
+struct tArchive {
+    char* filename;                               ///< The archive file, or NULL to keep the blocks in memory.
+    tByteBuffer memory;                           ///< The blocks, when there is no file.
+    const uint8_t* map;                           ///< The mapped file, or NULL.
+    size_t map_size;                              ///< The length of the mapping.
+    size_t blocks_size;                           ///< The bytes of the blocks, where the pending block is written.
+    tArchiveBlock* blocks;                        ///< Views of the blocks of the file.
+    int num_blocks;                               ///< The number of blocks of the file.
+    tByteBuffer pending[ARCHIVE_NUM_COLUMNS];     ///< Columns of the pending block.
+    uint32_t num_pending;                         ///< The number of games of the pending block.
+    char* pending_names[2 * ARCHIVE_BLOCK_GAMES]; ///< The names of the pending block.
+    int num_pending_names;                        ///< The number of names of the pending block.
+    tArchiveIndexEntry* index;                    ///< Per-player index, sorted by name.
+    int num_index;                                ///< The number of players in the index.
+    long num_games;                               ///< The number of archived games.
+};
+
+/**
+ * @brief A name in the NAMES column of a block.
+ */
+typedef struct {
+    const char* name;  ///< The bytes of the name, not null-terminated.
+    int length;        ///< The length of the name.
+} tArchiveName;
+
+/**
+ * @brief Decode the NAMES column of a block.
+ *
+ * @param block Pointer to a tArchiveBlock structure.
+ * @param[out] names Array with room for 2 * ARCHIVE_BLOCK_GAMES names.
+ * @return int The number of names.
+ */
+int archive_block_names(pArchiveBlock block, tArchiveName* names) {
+    const uint8_t* p = block->columns[ARCHIVE_NAMES];
+    const uint8_t* end = p + block->sizes[ARCHIVE_NAMES];
+    int num_names = 0;
+    while (p < end && num_names < 2 * ARCHIVE_BLOCK_GAMES) {
+        names[num_names].length = read_varint(&p);
+        names[num_names++].name = (const char*)p;
+        p += names[num_names - 1].length;
+    }
+    return num_names;
+}
+
+/**
+ * @brief Find a name in the NAMES column of a block.
+ *
+ * @param names The names of the block.
+ * @param num_names The number of names.
+ * @param name The name to find.
+ * @return int The index of the name, or -1 if not found.
+ */
+int archive_find_name(tArchiveName* names, int num_names, const char* name) {
+    int length = strlen(name);
+    for (int i = 0; i < num_names; i++) {
+        if (names[i].length == length && memcmp(names[i].name, name, length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Get the index entry of a player.
+ *
+ * @param archive Pointer to a tArchive structure.
+ * @param name The name of the player.
+ * @param add Whether to add an entry if there is none.
+ * @return tArchiveIndexEntry* The entry, or NULL if not found and not added.
+ */
+tArchiveIndexEntry* archive_index_entry(tArchive* archive, const char* name, bool add) {
+    int low = 0;
+    int high = archive->num_index;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (strcmp(archive->index[mid].name, name) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    if (low < archive->num_index && strcmp(archive->index[low].name, name) == 0) {
+        return &archive->index[low];
+    }
+    if (!add) return NULL;
+    archive->index = track_realloc(archive->index, sizeof(tArchiveIndexEntry) * (archive->num_index + 1));
+    memmove(&archive->index[low + 1], &archive->index[low], sizeof(tArchiveIndexEntry) * (archive->num_index - low));
+    archive->num_index++;
+    archive->index[low] = (tArchiveIndexEntry){copy_name((char*)name), NULL, 0};
+    return &archive->index[low];
+}
+
+/**
+ * @brief Record that a block includes games of a player.
+ *
+ * @param archive Pointer to a tArchive structure.
+ * @param name The name of the player.
+ * @param length The length of the name.
+ * @param block The index of the block.
+ */
+void archive_index_add(tArchive* archive, const char* name, int length, int block) {
+    char* copy = track_malloc(length + 1);
+    memcpy(copy, name, length);
+    copy[length] = '\0';
+    tArchiveIndexEntry* entry = archive_index_entry(archive, copy, true);
+    track_free(copy);
+    if (entry->num_blocks == 0 || entry->blocks[entry->num_blocks - 1] != block) {
+        entry->blocks = track_realloc(entry->blocks, sizeof(int) * (entry->num_blocks + 1));
+        entry->blocks[entry->num_blocks++] = block;
+    }
+}
+
+/**
+ * @brief Drop the blocks from a given one on from the per-player index.
+ *
+ * Players left without blocks are removed from the index.
+ *
+ * @param archive Pointer to a tArchive structure.
+ * @param first_block The index of the first block to drop.
+ */
+void archive_index_trim(tArchive* archive, int first_block) {
+    int kept = 0;
+    for (int i = 0; i < archive->num_index; i++) {
+        tArchiveIndexEntry* entry = &archive->index[i];
+        while (entry->num_blocks > 0 && entry->blocks[entry->num_blocks - 1] >= first_block) {
+            entry->num_blocks--;
+        }
+        if (entry->num_blocks == 0) {
+            track_free(entry->name);
+            track_free(entry->blocks);
+        } else {
+            archive->index[kept++] = *entry;
+        }
+    }
+    archive->num_index = kept;
+}
+
+/**
+ * @brief Map the archive file and find its blocks.
+ *
+ * Stops at the first incomplete or invalid block, e.g., after a crash while
+ * appending. The index is rebuilt for the blocks found after those of the
+ * previous mapping, and for any block that is gone.
+ *
+ * @param archive Pointer to a tArchive structure.
+ */
+void map_archive(tArchive* archive) {
+    int indexed = archive->num_blocks;
+    if (archive->map != NULL && archive->filename != NULL) {
+        munmap((void*)archive->map, archive->map_size);
+    }
+    archive->map = NULL;
+    archive->num_blocks = 0;
+    archive->num_games = 0;
+    archive->blocks_size = 0;
+    if (archive->filename == NULL) {
+        archive->map = archive->memory.size > 0 ? archive->memory.data : NULL;
+        archive->map_size = archive->memory.size;
+    } else {
+        int fd = open(archive->filename, O_RDONLY);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (data != MAP_FAILED) {
+                archive->map = data;
+                archive->map_size = st.st_size;
+            }
+        }
+        if (fd >= 0) close(fd);
+    }
+
+    size_t offset = 0;
+    while (archive->map != NULL && offset + sizeof(tArchiveBlockHeader) <= archive->map_size) {
+        tArchiveBlockHeader header;
+        memcpy(&header, archive->map + offset, sizeof(header));
+        size_t size = sizeof(header);
+        for (int i = 0; i < ARCHIVE_NUM_COLUMNS; i++) {
+            size += header.sizes[i];
+        }
+        if (memcmp(header.magic, ARCHIVE_MAGIC, sizeof(header.magic)) != 0 || header.num_games > ARCHIVE_BLOCK_GAMES ||
+            offset + size > archive->map_size) {
+            break;
+        }
+        archive->blocks = track_realloc(archive->blocks, sizeof(tArchiveBlock) * (archive->num_blocks + 1));
+        pArchiveBlock block = &archive->blocks[archive->num_blocks];
+        const uint8_t* column = archive->map + offset + sizeof(header);
+        for (int i = 0; i < ARCHIVE_NUM_COLUMNS; i++) {
+            block->columns[i] = column;
+            block->sizes[i] = header.sizes[i];
+            column += header.sizes[i];
+        }
+        block->num_games = header.num_games;
+        block->first_game = archive->num_games;
+        archive->num_games += header.num_games;
+        archive->num_blocks++;
+        offset += size;
+    }
+    archive->blocks_size = offset;
+
+    if (indexed > archive->num_blocks) {
+        indexed = archive->num_blocks;
+    }
+    // Drops the pending block too, which is indexed as the block after the last
+    archive_index_trim(archive, indexed);
+    for (int b = indexed; b < archive->num_blocks; b++) {
+        tArchiveName names[2 * ARCHIVE_BLOCK_GAMES];
+        int num_names = archive_block_names(&archive->blocks[b], names);
+        for (int i = 0; i < num_names; i++) {
+            archive_index_add(archive, names[i].name, names[i].length, b);
+        }
+    }
+}
+
+/**
+ * @brief Open an archive, creating the file on the first flush if it does not exist.
+ *
+ * @param archive Pointer to a tArchive structure.
+ * @param filename The archive file, or NULL to keep the archive in memory.
+ */
+void open_archive(tArchive* archive, char* filename) {
+    memset(archive, 0, sizeof(tArchive));
+    archive->filename = filename;
+    map_archive(archive);
+}
+
+/**
+ * @brief Write the pending block after the blocks of the archive.
+ *
+ * The block is written over the previous copy of the pending block, which is
+ * never longer.
+ *
+ * @param archive Pointer to a tArchive structure.
+ * @return true If the block was written.
+ * @return false If the file could not be written.
+ */
+bool write_pending_block(tArchive* archive) {
+    tArchiveBlockHeader header;
+    memcpy(header.magic, ARCHIVE_MAGIC, sizeof(header.magic));
+    header.num_games = archive->num_pending;
+    for (int i = 0; i < ARCHIVE_NUM_COLUMNS; i++) {
+        header.sizes[i] = archive->pending[i].size;
+    }
+    if (archive->filename == NULL) {
+        archive->memory.size = archive->blocks_size;
+        buffer_put_bytes(&archive->memory, &header, sizeof(header));
+        for (int i = 0; i < ARCHIVE_NUM_COLUMNS; i++) {
+            buffer_put_bytes(&archive->memory, archive->pending[i].data, archive->pending[i].size);
+        }
+        return true;
+    }
+    int fd = open(archive->filename, O_WRONLY | O_CREAT, 0644);
+    if (fd < 0) return false;
+    off_t offset = archive->blocks_size;
+    bool written = pwrite(fd, &header, sizeof(header), offset) == (ssize_t)sizeof(header);
+    offset += sizeof(header);
+    for (int i = 0; i < ARCHIVE_NUM_COLUMNS && written; i++) {
+        written = pwrite(fd, archive->pending[i].data, archive->pending[i].size, offset) == (ssize_t)archive->pending[i].size;
+        offset += archive->pending[i].size;
+    }
+    close(fd);
+    return written;
+}
+
+/**
+ * @brief Keep the blocks of an archive in memory, and stop writing its file.
+ *
+ * The blocks already in the file are copied to memory, and their views are
+ * moved there. The file keeps the blocks written so far.
+ *
+ * @param archive Pointer to a tArchive structure.
+ */
+void keep_archive_in_memory(tArchive* archive) {
+    archive->memory.size = 0;
+    buffer_put_bytes(&archive->memory, archive->map, archive->blocks_size);
+    for (int b = 0; b < archive->num_blocks; b++) {
+        for (int i = 0; i < ARCHIVE_NUM_COLUMNS; i++) {
+            archive->blocks[b].columns[i] = archive->memory.data + (archive->blocks[b].columns[i] - archive->map);
+        }
+    }
+    if (archive->map != NULL) {
+        munmap((void*)archive->map, archive->map_size);
+    }
+    archive->map = archive->memory.size > 0 ? archive->memory.data : NULL;
+    archive->map_size = archive->memory.size;
+    archive->filename = NULL;
+}
+
+/**
+ * @brief Write the pending block to the archive file, and start a new one when it is full.
+ *
+ * A partial block is written to the file only, so every finished game is on
+ * disk. A full block is also kept in memory when there is no file, and the
+ * archive is mapped again to include it. If the file cannot be written, the
+ * error is reported and the archive is kept in memory for the rest of the
+ * session, so that no finished game is lost.
+ *
+ * @param archive Pointer to a tArchive structure.
+ */
+void flush_archive(tArchive* archive) {
+    bool full = archive->num_pending == ARCHIVE_BLOCK_GAMES;
+    if (archive->num_pending == 0 || (archive->filename == NULL && !full)) return;
+    if (!write_pending_block(archive)) {
+        fprintf(stderr, "Ocorreu um erro ao gravar %s. O arquivo passa a ficar em memória.\n", archive->filename);
+        keep_archive_in_memory(archive);
+        if (full) write_pending_block(archive);
+    }
+    if (!full) return;
+    for (int i = 0; i < ARCHIVE_NUM_COLUMNS; i++) {
+        archive->pending[i].size = 0;
+    }
+    for (int i = 0; i < archive->num_pending_names; i++) {
+        track_free(archive->pending_names[i]);
+    }
+    archive->num_pending_names = 0;
+    archive->num_pending = 0;
+    map_archive(archive);
+}
+
+/**
+ * @brief Close an archive.
+ *
+ * The finished games are already written by flush_archive.
+ *
+ * @param archive Pointer to a tArchive structure.
+ */
+void close_archive(tArchive* archive) {
+    if (archive->map != NULL && archive->filename != NULL) {
+        munmap((void*)archive->map, archive->map_size);
+    }
+    buffer_free(&archive->memory);
+    track_free(archive->blocks);
+    for (int i = 0; i < ARCHIVE_NUM_COLUMNS; i++) {
+        buffer_free(&archive->pending[i]);
+    }
+    for (int i = 0; i < archive->num_pending_names; i++) {
+        track_free(archive->pending_names[i]);
+    }
+    for (int i = 0; i < archive->num_index; i++) {
+        track_free(archive->index[i].name);
+        track_free(archive->index[i].blocks);
+    }
+    track_free(archive->index);
+}
+
+/**
+ * @brief Get the number of blocks of an archive, including the pending block.
+ *
+ * @param archive Pointer to a tArchive structure.
+ * @return int The number of blocks.
+ */
+int archive_num_blocks(tArchive* archive) {
+    return archive->num_blocks + (archive->num_pending > 0 ? 1 : 0);
+}
+
+/**
+ * @brief Get a view of a block of an archive.
+ *
+ * @param archive Pointer to a tArchive structure.
+ * @param idx The index of the block, num_blocks for the pending block.
+ * @return tArchiveBlock The view of the block.
+ */
+tArchiveBlock archive_block(tArchive* archive, int idx) {
+    if (idx < archive->num_blocks) {
+        return archive->blocks[idx];
+    }
+    tArchiveBlock block;
+    for (int i = 0; i < ARCHIVE_NUM_COLUMNS; i++) {
+        block.columns[i] = archive->pending[i].data;
+        block.sizes[i] = archive->pending[i].size;
+    }
+    block.num_games = archive->num_pending;
+    block.first_game = archive->num_games - archive->num_pending;
+    return block;
+}
+
+/**
+ * @brief Get the index of a name in the pending block, adding it if needed.
+ *
+ * @param archive Pointer to a tArchive structure.
+ * @param name The name of the player.
+ * @return int The index of the name.
+ */
+int archive_pending_name(tArchive* archive, char* name) {
+    for (int i = 0; i < archive->num_pending_names; i++) {
+        if (strcmp(archive->pending_names[i], name) == 0) {
+            return i;
+        }
+    }
+    int length = strlen(name);
+    buffer_put_varint(&archive->pending[ARCHIVE_NAMES], length);
+    buffer_put_bytes(&archive->pending[ARCHIVE_NAMES], name, length);
+    archive_index_add(archive, name, length, archive->num_blocks);
+    archive->pending_names[archive->num_pending_names] = copy_name(name);
+    return archive->num_pending_names++;
+}
+
+/**
+ * @brief Add a finished game to an archive.
+ *
+ * Moves played before the game was loaded with L are not known, so only the
+ * moves of the move log are archived.
+ *
+ * @param archive Pointer to a tArchive structure.
+ * @param game Pointer to a tGame structure, with the game still in progress.
+ * @param result 0 for a draw, 1 or 2 for a win of the first or second player.
+ */
+void archive_game(tArchive* archive, pGame game, int result) {
+    buffer_put_varint(&archive->pending[ARCHIVE_PLAYERS], archive_pending_name(archive, registry_name(&game->registry, game->player1->player)));
+    buffer_put_varint(&archive->pending[ARCHIVE_PLAYERS], archive_pending_name(archive, registry_name(&game->registry, game->player2->player)));
+    buffer_put_varint(&archive->pending[ARCHIVE_RESULTS], result);
+    buffer_put_varint(&archive->pending[ARCHIVE_RESULTS], game->num_moves);
+    pByteBuffer configs = &archive->pending[ARCHIVE_CONFIGS];
+    buffer_put_varint(configs, game->width);
+    buffer_put_varint(configs, game->height);
+    buffer_put_varint(configs, game->sequence_size);
+    buffer_put_varint(configs, game->num_special_sequences);
+    for (int i = 0; i < game->num_special_sequences; i++) {
+        buffer_put_varint(configs, game->special_sequences[i]);
+    }
+    buffer_put_varint(&archive->pending[ARCHIVE_MOVES], game->move_log.size);
+    buffer_put_bytes(&archive->pending[ARCHIVE_MOVES], game->move_log.data, game->move_log.size);
+    archive->num_pending++;
+    archive->num_games++;
+    flush_archive(archive);
+}
+
+/**
+ * @brief Prints the last games of a player.
+ *
+ * Reads only the NAMES, PLAYERS and RESULTS columns of the blocks where the
+ * player appears, from the newest to the oldest.
+ *
+ * @param out The output stream.
+ * @param archive Pointer to a tArchive structure.
+ * @param name The name of the player.
+ * @param count The maximum number of games to print.
+ */
+void print_player_games(FILE* out, tArchive* archive, char* name, int count) {
+    tArchiveIndexEntry* entry = archive_index_entry(archive, name, false);
+    if (entry == NULL) {
+        fprintf(out, "Sem jogos arquivados.\n");
+        return;
+    }
+    static const char* RESULTS[] = {"Empate", "Vitória", "Derrota"};
+    for (int b = entry->num_blocks - 1; b >= 0 && count > 0; b--) {
+        tArchiveBlock block = archive_block(archive, entry->blocks[b]);
+        tArchiveName names[2 * ARCHIVE_BLOCK_GAMES];
+        int num_names = archive_block_names(&block, names);
+        int idx = archive_find_name(names, num_names, name);
+        int games[ARCHIVE_BLOCK_GAMES][4];  // Opponent, result for the player, moves, game
+        int num_games = 0;
+        const uint8_t* players = block.columns[ARCHIVE_PLAYERS];
+        const uint8_t* results = block.columns[ARCHIVE_RESULTS];
+        for (uint32_t g = 0; g < block.num_games; g++) {
+            int first = read_varint(&players);
+            int second = read_varint(&players);
+            int result = read_varint(&results);
+            int moves = read_varint(&results);
+            if (first == idx || second == idx) {
+                int seat = first == idx ? 1 : 2;
+                games[num_games][0] = first == idx ? second : first;
+                games[num_games][1] = result == 0 ? 0 : result == seat ? 1 : 2;
+                games[num_games][2] = moves;
+                games[num_games++][3] = g;
+            }
+        }
+        for (int i = num_games - 1; i >= 0 && count > 0; i--, count--) {
+            tArchiveName* opponent = &names[games[i][0]];
+            fprintf(out, "%ld %.*s %s %d\n", block.first_game + games[i][3] + 1, opponent->length, opponent->name, RESULTS[games[i][1]], games[i][2]);
+        }
+    }
+}
+
+/**
+ * @brief Prints the head-to-head record of two players.
+ *
+ * Reads only the NAMES, PLAYERS and RESULTS columns of the blocks where both
+ * players appear.
+ *
+ * @param out The output stream.
+ * @param archive Pointer to a tArchive structure.
+ * @param name1 The name of the first player.
+ * @param name2 The name of the second player.
+ */
+void print_head_to_head(FILE* out, tArchive* archive, char* name1, char* name2) {
+    tArchiveIndexEntry* entry1 = archive_index_entry(archive, name1, false);
+    tArchiveIndexEntry* entry2 = archive_index_entry(archive, name2, false);
+    int wins1 = 0;
+    int wins2 = 0;
+    int draws = 0;
+    for (int i = 0, j = 0; entry1 != NULL && entry2 != NULL && i < entry1->num_blocks && j < entry2->num_blocks;) {
+        if (entry1->blocks[i] < entry2->blocks[j]) {
+            i++;
+        } else if (entry1->blocks[i] > entry2->blocks[j]) {
+            j++;
+        } else {
+            tArchiveBlock block = archive_block(archive, entry1->blocks[i]);
+            tArchiveName names[2 * ARCHIVE_BLOCK_GAMES];
+            int num_names = archive_block_names(&block, names);
+            int idx1 = archive_find_name(names, num_names, name1);
+            int idx2 = archive_find_name(names, num_names, name2);
+            const uint8_t* players = block.columns[ARCHIVE_PLAYERS];
+            const uint8_t* results = block.columns[ARCHIVE_RESULTS];
+            for (uint32_t g = 0; g < block.num_games; g++) {
+                int first = read_varint(&players);
+                int second = read_varint(&players);
+                int result = read_varint(&results);
+                read_varint(&results);
+                if ((first == idx1 && second == idx2) || (first == idx2 && second == idx1)) {
+                    int winner = result == 0 ? -1 : result == 1 ? first : second;
+                    wins1 += winner == idx1;
+                    wins2 += winner == idx2;
+                    draws += winner == -1;
+                }
+            }
+            i++;
+            j++;
+        }
+    }
+    fprintf(out, "%s %d\n", name1, wins1);
+    fprintf(out, "%s %d\n", name2, wins2);
+    fprintf(out, "Empates %d\n", draws);
+}
+
+/**
+ * @brief Prints an archived game.
+ *
+ * Prints the configuration, the players and the result, then one line per
+ * move with the player, the size, and the line and column of each piece.
+ *
+ * @param out The output stream.
+ * @param archive Pointer to a tArchive structure.
+ * @param number The number of the game, starting at 1.
+ * @return bool True if the game exists.
+ */
+bool print_archived_game(FILE* out, tArchive* archive, long number) {
+    int b = 0;
+    int num_blocks = archive_num_blocks(archive);
+    tArchiveBlock block;
+    for (; b < num_blocks; b++) {
+        block = archive_block(archive, b);
+        if (number > block.first_game && number <= block.first_game + block.num_games) break;
+    }
+    if (number < 1 || b == num_blocks) return false;
+    long g = number - 1 - block.first_game;
+    tArchiveName names[2 * ARCHIVE_BLOCK_GAMES];
+    archive_block_names(&block, names);
+    const uint8_t* players = block.columns[ARCHIVE_PLAYERS];
+    const uint8_t* results = block.columns[ARCHIVE_RESULTS];
+    const uint8_t* configs = block.columns[ARCHIVE_CONFIGS];
+    const uint8_t* moves = block.columns[ARCHIVE_MOVES];
+    for (long i = 0; i < g; i++) {
+        read_varint(&players);
+        read_varint(&players);
+        read_varint(&results);
+        read_varint(&results);
+        for (int k = 0; k < 3; k++) read_varint(&configs);
+        for (int k = read_varint(&configs); k > 0; k--) read_varint(&configs);
+        moves += read_varint(&moves);
+    }
+    tArchiveName* seats[2];
+    seats[0] = &names[read_varint(&players)];
+    seats[1] = &names[read_varint(&players)];
+    int result = read_varint(&results);
+    int num_moves = read_varint(&results);
+    int width = read_varint(&configs);
+    int height = read_varint(&configs);
+    fprintf(out, "%d %d %d\n", width, height, (int)read_varint(&configs));
+    for (int k = read_varint(&configs); k > 0; k--) {
+        fprintf(out, "%d%s", (int)read_varint(&configs), k > 1 ? " " : "");
+    }
+    fprintf(out, "\n%.*s %.*s ", seats[0]->length, seats[0]->name, seats[1]->length, seats[1]->name);
+    if (result == 0) {
+        fprintf(out, "Empate\n");
+    } else {
+        fprintf(out, "%.*s\n", seats[result - 1]->length, seats[result - 1]->name);
+    }
+    read_varint(&moves);
+    for (int m = 0; m < num_moves; m++) {
+        uint64_t move = read_varint(&moves);
+        int size = move >> 1;
+        fprintf(out, "%.*s %d", seats[move & 1]->length, seats[move & 1]->name, size);
+        for (int k = 0; k < size; k++) {
+            int line = read_varint(&moves);
+            int column = read_varint(&moves);
+            fprintf(out, " %d %d", line + 1, column + 1);
+        }
+        fprintf(out, "\n");
+    }
+    return true;
+}
+
+/**
+ * @brief Terminates the current game.
+ *
+ * This function terminates the current game. The function should be called when
+ * a player wins or when the game is a draw.
+ *
+ * The second_name parameter is NULL if one of the players wins, and first_name
+ * is then the player who loses, by giving up or because the other player
+ * completed a sequence. If the game is a draw, no player records a win.
+ *
+ * The game is added to the archive of the session, if any.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param first_name The name of the first player, or of the player who loses.
+ * @param second_name The name of the second player, or NULL.
+ */
+void game_over(pGame game, char* first_name, char* second_name) {
+    pInGamePlayer player = get_in_game_player(game, first_name);
+    pRegistry registry = &game->registry;
+    // A player may play against itself, and must then be ranked only once
+    bool same_player = game->player1->player == game->player2->player;
+    rankings_remove(game, game->player1->player);
+    if (!same_player) rankings_remove(game, game->player2->player);
+    int result = 0;
+    if (second_name == NULL) {
+        pInGamePlayer winner = get_other_in_game_player(game, first_name);
+        registry->wins[registry->index[winner->player]]++;
+        result = winner == game->player1 ? 1 : 2;
+    }
+    if (game->archive != NULL) {
+        archive_game(game->archive, game, result);
+    }
+
+    registry->games_played[registry->index[game->player1->player]]++;
+    registry->games_played[registry->index[game->player2->player]]++;
+    rankings_insert(game, game->player1->player);
+    if (!same_player) rankings_insert(game, game->player2->player);
+    publish_player_records(game, game->player1->player);
+    publish_player_records(game, game->player2->player);
+
+    for (int l = 0; l < game->height; l++) {
+        track_free(game->board[l]);
+    }
+    track_free(game->board);
+    game->board = NULL;
+    free_windows(game);
+    buffer_free(&game->move_log);
+    game->num_moves = 0;
+
+    track_free(game->special_sequences);
+    game->special_sequences = NULL;
+
+    free_bot(game->player1->bot);
+    free_bot(game->player2->bot);
+    track_free(game->player1->special_sequences);
+    track_free(game->player2->special_sequences);
+    track_free(game->player1);
+    track_free(game->player2);
+    game->player1 = NULL;
+    game->player2 = NULL;
+    publish_board(game);
+}
+
+/**
+ * @brief Play a piece of an in-game player, and print the outcome.
+ *
+ * The move must be valid. Ends the game if the piece completes a sequence, or
+ * if no player can win anymore.
+ *
+ * @param out The output stream.
+ * @param game Pointer to a tGame structure.
+ * @param name The name of the player.
+ * @param size The size of the piece.
+ * @param column The column of the piece.
+ * @param direction The direction of the piece.
+ * @return true If the game goes on.
+ * @return false If the game is over.
+ */
+bool play_piece(FILE* out, pGame game, char* name, int size, int column, char* direction) {
+    int* lines = track_malloc(sizeof(int) * size);
+    int* columns = track_malloc(sizeof(int) * size);
+    game->engine->drop(game, name, size, column, direction, lines, columns);
+    bool player_won = false;
+    for (int i = 0; i < size; i++) {
+        if (game->engine->wins(game, name, lines[i], columns[i])) {
+            game_over(game, registry_name(&game->registry, get_other_in_game_player(game, name)->player), NULL);
+            player_won = true;
+            fprintf(out, "Sequência conseguida. Jogo terminado.\n");
+            break;
+        }
+    }
+    bool goes_on = false;
+    if (!player_won && dead_game(game)) {
+        game_over(game, name, registry_name(&game->registry, get_other_in_game_player(game, name)->player));
+        fprintf(out, "Empate. Jogo terminado.\n");
+    } else if (!player_won) {
+        fprintf(out, "Peça colocada.\n");
+        goes_on = true;
+    }
+    track_free(lines);
+    track_free(columns);
+    return goes_on;
+}
+
+#define BOT_MAX_ENTRIES (1 << 20)  ///< Solver entries kept by a bot before its tables are reset.
+
+/**
+ * @brief The best reply found to a move of the opponent of a bot.
+ */
+typedef struct {
+    uint64_t hash;  ///< Hash of the position after the move of the opponent.
+    tMove move;     ///< The best reply.
+    int result;     ///< The result of the reply, for the bot.
+    int depth;      ///< The depth searched, 0 if the reply was not searched.
+} tBotReply;
+
+/**
+ * @brief A bot playing for an in-game player.
+ *
+ * While the opponent decides, a worker thread ponders: it deepens the search of
+ * the best reply to each move the opponent can play. When the opponent plays,
+ * the reply to the actual move is reused, and the worker thread deepens it
+ * further until the latency budget of the bot runs out. The solver tables are
+ * kept from move to move, so every search reuses the positions already solved.
+ *
+ * The worker thread only uses the position and tables of the bot, which are
+ * only touched by the session once the worker thread has been stopped.
+ */
+struct tBot {
+    long budget;              ///< Time to answer a move, in ms.
+    tSolver solver;           ///< Positions solved and searched in the game.
+    tPosition pos;            ///< The root of the search.
+    tMove* moves;             ///< Moves of the opponent, when pondering.
+    tBotReply* replies;       ///< Best reply to each move in moves.
+    int num_moves;            ///< The number of moves.
+    tMove best;               ///< Best move of the bot, when thinking.
+    int result;               ///< The result of best.
+    int depth;                ///< The depth searched for best.
+    bool pondering;           ///< Whether the worker thread ponders or thinks.
+    pthread_t thread;         ///< The worker thread.
+    bool searching;           ///< Whether the worker thread was started and not joined.
+    atomic_bool stop;         ///< Asks the worker thread to stop.
+    pthread_mutex_t lock;     ///< Protects done.
+    pthread_cond_t finished;  ///< Signaled when done is set.
+    bool done;                ///< Whether the worker thread finished its search.
+    tMemTracker* tracker;     ///< The tracker of the thread that started the worker thread.
+};
+
+/**
+ * @brief Rank of a result, higher is better.
+ *
+ * An unknown result is preferred to a draw, so the bot keeps playing to win
+ * while it can.
+ *
+ * @param result The result of a move.
+ * @return int The rank.
+ */
+int bot_result_rank(int result) {
+    return result == RESULT_WIN ? 3 : result == RESULT_UNKNOWN ? 2 : result == RESULT_DRAW ? 1 : 0;
+}
+
+/**
+ * @brief Search the best move of the player to move.
+ *
+ * Moves that win at once are preferred, then the moves are compared by the
+ * result of a search of the given depth. Ties keep the order of
+ * position_moves, which favors the center.
+ *
+ * @param solver Pointer to a tSolver structure.
+ * @param pos Pointer to a tPosition structure.
+ * @param depth The number of moves to search, including the move chosen.
+ * @param[out] best The best move, unchanged if there are no legal moves.
+ * @return int The result of the best move.
+ */
+int bot_search(pSolver solver, pPosition pos, int depth, tMove* best) {
+    tMove* moves = track_malloc(sizeof(tMove) * pos->width * (pos->num_sizes + 1));
+    int num_moves = position_moves(pos, moves);
+    int best_result = RESULT_DRAW;
+    int best_rank = -1;
+    for (int i = 0; i < num_moves && best_result != RESULT_WIN; i++) {
+        if (position_play(pos, moves[i])) {
+            *best = moves[i];
+            best_result = RESULT_WIN;
+        }
+        position_undo(pos, moves[i]);
+    }
+    for (int i = 0; i < num_moves && best_result != RESULT_WIN; i++) {
+        position_play(pos, moves[i]);
+        int child = solve(solver, pos, depth - 1);
+        position_undo(pos, moves[i]);
+        int result = child == RESULT_LOSS ? RESULT_WIN : child == RESULT_WIN ? RESULT_LOSS : child;
+        if (bot_result_rank(result) > best_rank) {
+            best_rank = bot_result_rank(result);
+            best_result = result;
+            *best = moves[i];
+        }
+    }
+    track_free(moves);
+    return best_result;
+}
+
+/**
+ * @brief Bot worker thread.
+ *
+ * Deepens the search one move at a time, until it is stopped, every result is
+ * exact, or the search covers the whole board. The results of a depth are only
+ * kept if the depth was searched to the end.
+ *
+ * @param arg Pointer to a tBot structure.
+ * @return void* NULL.
+ */
+void* bot_main(void* arg) {
+    tBot* bot = arg;
+    mem_use_tracker(bot->tracker);
+    mem_set_command("XB");
+    pPosition pos = &bot->pos;
+    for (int depth = bot->depth + 1; depth <= pos->empty && !atomic_load(&bot->stop); depth++) {
+        bool exact = true;
+        if (bot->pondering) {
+            for (int i = 0; i < bot->num_moves && !atomic_load(&bot->stop); i++) {
+                tBotReply* reply = &bot->replies[i];
+                if (!position_play(pos, bot->moves[i]) && (reply->depth == 0 || reply->result == RESULT_UNKNOWN)) {
+                    tMove best = bot->moves[i];
+                    int result = bot_search(&bot->solver, pos, depth, &best);
+                    if (!atomic_load(&bot->stop)) {
+                        *reply = (tBotReply){pos->hash, best, result, depth};
+                    }
+                    exact &= result != RESULT_UNKNOWN;
+                }
+                position_undo(pos, bot->moves[i]);
+            }
+        } else {
+            tMove best = bot->best;
+            int result = bot_search(&bot->solver, pos, depth, &best);
+            if (!atomic_load(&bot->stop)) {
+                bot->best = best;
+                bot->result = result;
+                bot->depth = depth;
+            }
+            exact = result != RESULT_UNKNOWN;
+        }
+        if (exact || bot->solver.results.num_entries + bot->solver.searched.num_entries > BOT_MAX_ENTRIES) {
+            break;
+        }
+    }
+    pthread_mutex_lock(&bot->lock);
+    bot->done = true;
+    pthread_cond_signal(&bot->finished);
+    pthread_mutex_unlock(&bot->lock);
+    return NULL;
+}
+
+/**
+ * @brief Start the worker thread of a bot.
+ *
+ * @param bot Pointer to a tBot structure.
+ */
+void bot_start(tBot* bot) {
+    atomic_store(&bot->stop, false);
+    bot->done = false;
+    bot->searching = true;
+    bot->tracker = mem_get_tracker();
+    pthread_create(&bot->thread, NULL, bot_main, bot);
+}
+
+/**
+ * @brief Stop the worker thread of a bot, if it is running.
+ *
+ * @param bot Pointer to a tBot structure, or NULL.
+ */
+void bot_stop(tBot* bot) {
+    if (bot != NULL && bot->searching) {
+        atomic_store(&bot->stop, true);
+        pthread_join(bot->thread, NULL);
+        bot->searching = false;
+    }
+}
+
+/**
+ * @brief Set the root of the search of a bot to the board of the game.
+ *
+ * Unused special sequence sizes below 2 (e.g., from an empty special sequence
+ * line) are left out, as in query_tablebase.
+ *
+ * @param bot Pointer to a tBot structure, with its worker thread stopped.
+ * @param game Pointer to a tGame structure.
+ * @param player Pointer to the tInGamePlayer to move.
+ */
+void bot_sync(tBot* bot, pGame game, pInGamePlayer player) {
+    int specials[TABLEBASE_MAX_SPECIALS];
+    int num_specials = 0;
+    for (int i = 0; i < game->num_special_sequences; i++) {
+        if (game->special_sequences[i] > 1) {
+            specials[num_specials++] = game->special_sequences[i];
+        }
+    }
+    position_free(&bot->pos);
+    position_init(&bot->pos, game->width, game->height, game->sequence_size, specials, num_specials);
+    for (int l = 0; l < game->height; l++) {
+        for (int c = 0; c < game->width; c++) {
+            if (game->board[l][c] != NULL) {
+                position_set_cell(&bot->pos, l, c, game->board[l][c] == game->player1 ? 1 : 2);
+            }
+        }
+    }
+    // Pieces fall to the bottom of each column, so the top is the first piece
+    for (int c = 0; c < game->width; c++) {
+        while (bot->pos.top[c] > 0 && game->board[bot->pos.top[c] - 1][c] != NULL) {
+            bot->pos.top[c]--;
+        }
+    }
+    pInGamePlayer players[2] = {game->player1, game->player2};
+    for (int p = 0; p < 2; p++) {
+        for (int i = 0; i < bot->pos.num_sizes; i++) {
+            int count = 0;
+            for (int j = 0; j < players[p]->num_special_sequences; j++) {
+                count += players[p]->special_sequences[j] == bot->pos.sizes[i];
+            }
+            position_set_count(&bot->pos, p, i, count);
+        }
+    }
+    if (player == game->player2) {
+        position_toggle_turn(&bot->pos);
+    }
+    if (bot->solver.results.num_entries + bot->solver.searched.num_entries > BOT_MAX_ENTRIES) {
+        track_free(bot->solver.results.slots);
+        track_free(bot->solver.searched.slots);
+        position_table_init(&bot->solver.results, 1024);
+        position_table_init(&bot->solver.searched, 1024);
+    }
+}
+
+/**
+ * @brief Start pondering the replies to the next move of the opponent of a bot.
+ *
+ * A bot without a budget does not ponder, so its moves only depend on the
+ * board.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param player Pointer to the tInGamePlayer of the bot.
+ */
+void bot_ponder(pGame game, pInGamePlayer player) {
+    tBot* bot = player->bot;
+    bot_stop(bot);
+    bot_sync(bot, game, player == game->player1 ? game->player2 : game->player1);
+    bot->num_moves = position_moves(&bot->pos, bot->moves);
+    memset(bot->replies, 0, sizeof(tBotReply) * bot->num_moves);
+    bot->pondering = true;
+    bot->depth = 1;
+    if (bot->num_moves > 0 && bot->budget > 0) {
+        bot_start(bot);
+    }
+}
+
+/**
+ * @brief Play the move of a bot, and print it and its outcome.
+ *
+ * The pondered reply to the move of the opponent is used if there is one,
+ * otherwise a search two moves deep finds the wins and the blocks. The worker
+ * thread then deepens the search until the budget runs out. If the game goes
+ * on, the bot starts pondering again.
+ *
+ * @param out The output stream.
+ * @param game Pointer to a tGame structure.
+ * @param player Pointer to the tInGamePlayer of the bot.
+ */
+void bot_play(FILE* out, pGame game, pInGamePlayer player) {
+    tBot* bot = player->bot;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += bot->budget / 1000;
+    deadline.tv_nsec += bot->budget % 1000 * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    bot_stop(bot);
+    bot_sync(bot, game, player);
+    bool pondered = false;
+    for (int i = 0; i < bot->num_moves && bot->pondering && !pondered; i++) {
+        tBotReply* reply = &bot->replies[i];
+        if (reply->depth > 0 && reply->hash == bot->pos.hash) {
+            bot->best = reply->move;
+            bot->result = reply->result;
+            bot->depth = reply->depth;
+            pondered = true;
+        }
+    }
+    if (!pondered) {
+        bot->result = bot_search(&bot->solver, &bot->pos, 2, &bot->best);
+        bot->depth = 2;
+    }
+    bot->pondering = false;
+    if (bot->result == RESULT_UNKNOWN && bot->budget > 0) {
+        bot_start(bot);
+        pthread_mutex_lock(&bot->lock);
+        while (!bot->done && pthread_cond_timedwait(&bot->finished, &bot->lock, &deadline) == 0) {
+        }
+        pthread_mutex_unlock(&bot->lock);
+        bot_stop(bot);
+    }
+    char* name = registry_name(&game->registry, player->player);
+    fprintf(out, "%s joga %d %d D.\n", name, bot->best.size, bot->best.column + 1);
+    if (play_piece(out, game, name, bot->best.size, bot->best.column + 1, "D")) {
+        bot_ponder(game, player);
+    }
+}
+
+/**
+ * @brief Attach a bot to an in-game player, replacing its previous bot.
+ *
+ * The bot starts pondering the next move of the opponent at once, if it has a
+ * budget.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param player Pointer to a tInGamePlayer structure.
+ * @param budget Time to answer a move, in ms.
+ */
+void attach_bot(pGame game, pInGamePlayer player, long budget) {
+    free_bot(player->bot);
+    tBot* bot = track_malloc(sizeof(tBot));
+    memset(bot, 0, sizeof(tBot));
+    bot->budget = budget;
+    position_table_init(&bot->solver.results, 1024);
+    position_table_init(&bot->solver.searched, 1024);
+    bot->solver.stop = &bot->stop;
+    atomic_init(&bot->stop, false);
+    // Replaced by bot_sync before every search
+    position_init(&bot->pos, 1, 1, 1, NULL, 0);
+    int max_moves = game->width * (game->num_special_sequences + 1);
+    bot->moves = track_malloc(sizeof(tMove) * max_moves);
+    bot->replies = track_malloc(sizeof(tBotReply) * max_moves);
+    pthread_mutex_init(&bot->lock, NULL);
+    pthread_cond_init(&bot->finished, NULL);
+    player->bot = bot;
+    bot_ponder(game, player);
+}
+
+/**
+ * @brief Stop a bot and free it.
+ *
+ * @param bot Pointer to a tBot structure, or NULL.
+ */
+void free_bot(tBot* bot) {
+    if (bot == NULL) {
+        return;
+    }
+    bot_stop(bot);
+    track_free(bot->solver.results.slots);
+    track_free(bot->solver.searched.slots);
+    position_free(&bot->pos);
+    track_free(bot->moves);
+    track_free(bot->replies);
+    pthread_mutex_destroy(&bot->lock);
+    pthread_cond_destroy(&bot->finished);
+    track_free(bot);
+}
+
+/**
+ * @brief Prints the number of special sequences of a given player.
+ *
+ * @param out The output stream.
+ * @param game Pointer to a tGame structure.
+ * @param name The name of the player.
+ * @return int The number of special sequences of the given player.
+ */
+void print_player_special_sequences(FILE* out, pGame game, pInGamePlayer player) {
+    int num_unique_special_sequences;
+    int* unique_special_sequences = get_unique_special_sequences(game, &num_unique_special_sequences);
+    for (int i = 0; i < num_unique_special_sequences; i++) {
+        int count = 0;
+        for (int j = 0; j < player->num_special_sequences; j++) {
+            if (player->special_sequences[j] == unique_special_sequences[i]) {
+                count++;
+            }
+        }
+        fprintf(out, "%d %d\n", unique_special_sequences[i], count);
+    }
+    track_free(unique_special_sequences);
+}
+
+/**
+ * @brief Prints the contents of a board position.
+ *
+ * @param out The output stream.
+ * @param game Pointer to a tGame structure.
+ * @param line The line of the position.
+ * @param column The column of the position.
+ */
+void print_position(FILE* out, pGame game, int line, int column) {
+    fprintf(out, "%d %d ", line + 1, column + 1);
+    if (game->board[line][column] == NULL) {
+        fprintf(out, "Vazio\n");
+    } else {
+        fprintf(out, "%s\n", registry_name(&game->registry, game->board[line][column]->player));
+    }
+}
+
+/**
+ * @brief Prints the board positions changed since a given version.
+ *
+ * Prints the current version, followed by the changed positions, in the VR
+ * format. If the changes since the given version are no longer recorded, or
+ * the version is unknown, all positions are printed.
+ *
+ * @param out The output stream.
+ * @param game Pointer to a tGame structure.
+ * @param version The version known by the client.
+ */
+void print_changes(FILE* out, pGame game, long version) {
+    fprintf(out, "%ld\n", game->version);
+    if (version < game->dropped_version || version > game->version) {
+        for (int r = 0; r < game->height; r++) {
+            for (int c = 0; c < game->width; c++) {
+                print_position(out, game, r, c);
+            }
+        }
+        return;
+    }
+    int first = game->num_changes;
+    while (first > 0 && game->changes[(game->changes_start + first - 1) % CHANGES_CAPACITY].version > version) {
+        first--;
+    }
+    for (int i = first; i < game->num_changes; i++) {
+        tCellChange* change = &game->changes[(game->changes_start + i) % CHANGES_CAPACITY];
+        print_position(out, game, change->line, change->column);
+    }
+}
+
+/**
+ * @brief Prints every position of the board, as VR.
+ *
+ * @param out The output stream.
+ * @param game Pointer to a tGame structure, with a game in progress.
+ */
+void print_board(FILE* out, pGame game) {
+    for (int r = 0; r < game->height; r++) {
+        for (int c = 0; c < game->width; c++) {
+            print_position(out, game, r, c);
+        }
+    }
+}
+
+/**
+ * @brief Saves the game to a file.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param filename The name of the file.
+ */
+void save_game(pGame game, char* filename) {
+    FILE* fp = fopen(filename, "w");
+    pRegistry registry = &game->registry;
+    fprintf(fp, "%d\n", registry->num_players);
+    for (int i = 0; i < registry->num_players; i++) {
+        fprintf(fp, "%s %d %d\n", registry->names + registry->name_offsets[i], registry->games_played[i], registry->wins[i]);
+    }
+    if (in_game(game)) {
+        fprintf(fp, "%d %d %d\n", game->height, game->width, game->sequence_size);
+        fprintf(fp, "%d ", game->num_special_sequences);
+        for (int i = 0; i < game->num_special_sequences; i++) {
+            fprintf(fp, "%d ", game->special_sequences[i]);
+        }
+        fprintf(fp, "\n");
+        fprintf(fp, "%s ", registry_name(registry, game->player1->player));
+        for (int i = 0; i < game->player1->num_special_sequences; i++) {
+            fprintf(fp, "%d ", game->player1->special_sequences[i]);
+        }
+        fprintf(fp, "\n");
+        fprintf(fp, "%s ", registry_name(registry, game->player2->player));
+        for (int i = 0; i < game->player2->num_special_sequences; i++) {
+            fprintf(fp, "%d ", game->player2->special_sequences[i]);
+        }
+        fprintf(fp, "\n");
+        for (int l = 0; l < game->height; l++) {
+            for (int c = 0; c < game->width; c++) {
+                if (game->board[l][c] == NULL) {
+                    fprintf(fp, "0 ");
+                } else if (game->board[l][c] == game->player1) {
+                    fprintf(fp, "1 ");
+                } else {
+                    fprintf(fp, "2 ");
+                }
+            }
+            fprintf(fp, "\n");
+        }
+    }
+    fclose(fp);
+}
+
+/**
+ * @brief Size of the chunks read by a tReader.
+ */
+#define READER_CHUNK_SIZE (1 << 20)
+
+/**
+ * @brief Buffered line reader.
+ *
+ * Reads a file in large chunks, and returns its lines in place, without
+ * allocating memory per line.
+ */
+typedef struct {
+    FILE* fp;         ///< The file being read.
+    char* buffer;     ///< The chunk buffer.
+    size_t capacity;  ///< The size of the buffer.
+    size_t start;     ///< Offset of the first unread byte.
+    size_t end;       ///< Offset after the last byte read from the file.
+    bool eof;         ///< Whether the end of file was reached.
+} tReader, *pReader;
+
+/**
+ * @brief Initialize a reader.
+ *
+ * This function allocates memory for the buffer. It is released by
+ * free_reader.
+ *
+ * @param reader Pointer to a tReader structure.
+ * @param fp Pointer to a file.
+ */
+void init_reader(pReader reader, FILE* fp) {
+    reader->fp = fp;
+    reader->capacity = READER_CHUNK_SIZE;
+    reader->buffer = track_malloc(reader->capacity);
+    reader->start = 0;
+    reader->end = 0;
+    reader->eof = false;
+}
+
+/**
+ * @brief Frees the buffer of a reader.
+ *
+ * @param reader Pointer to a tReader structure.
+ */
+void free_reader(pReader reader) {
+    track_free(reader->buffer);
+    reader->buffer = NULL;
+}
+
+/**
+ * @brief Read the next line.
+ *
+ * The line terminator is replaced by '\0', and the line is returned in place.
+ * It is valid until the next call. Lines longer than the buffer make it grow.
+ *
+ * @param reader Pointer to a tReader structure.
+ * @return char* The line, or NULL at the end of the file.
+ */
+char* reader_next_line(pReader reader) {
+    while (true) {
+        char* data = reader->buffer + reader->start;
+        char* newline = memchr(data, '\n', reader->end - reader->start);
+        if (newline != NULL) {
+            *newline = '\0';
+            reader->start = newline - reader->buffer + 1;
+            return data;
+        }
+        if (reader->eof) {
+            if (reader->start == reader->end) {
+                return NULL;
+            }
+            reader->buffer[reader->end] = '\0';
+            reader->start = reader->end;
+            return data;
+        }
+        memmove(reader->buffer, data, reader->end - reader->start);
+        reader->end -= reader->start;
+        reader->start = 0;
+        // Keep one byte for the terminator of a last line without newline
+        if (reader->end + 1 == reader->capacity) {
+            reader->capacity *= 2;
+            reader->buffer = track_realloc(reader->buffer, reader->capacity);
+        }
+        size_t count = fread(reader->buffer + reader->end, 1, reader->capacity - reader->end - 1, reader->fp);
+        if (count == 0) {
+            reader->eof = true;
+        }
+        reader->end += count;
+    }
+}
+
+/**
+ * @brief Loads the record of a player in the current game from a file.
+ *
+ * This function allocates memory for the player. The caller is responsible for
+ * freeing the memory.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param reader Pointer to a reader of the file.
+ * @return Pointer to a tInGamePlayer structure, or NULL if the line is missing
+ * or names an unregistered player.
+ */
+pInGamePlayer load_in_game_player(pGame game, pReader reader) {
+    char* save_ptr;
+    char* line = reader_next_line(reader);
+    char* player_name = line == NULL ? NULL : strtok_r(line, " ", &save_ptr);
+    if (player_name == NULL || get_player(game, player_name) == -1) {
+        return NULL;
+    }
+    pInGamePlayer player = track_malloc(sizeof(tInGamePlayer));
+    player->num_special_sequences = 0;
+    player->special_sequences = NULL;
+    player->bot = NULL;
+    player->player = get_player(game, player_name);
+    char* special_sequence = strtok_r(NULL, " ", &save_ptr);
+    while (special_sequence != NULL) {
+        player->num_special_sequences++;
+        player->special_sequences = track_realloc(player->special_sequences, player->num_special_sequences * sizeof(int));
+        player->special_sequences[player->num_special_sequences - 1] = atoi(special_sequence);
+        special_sequence = strtok_r(NULL, " ", &save_ptr);
+    }
+    return player;
+}
+
+/**
+ * @brief Loads the registered players from a file.
+ *
+ * The registry arrays are sized from the count header, and the names arena
+ * starts at the size of a reader chunk. Players get the ids 0 to n-1, in file
+ * order. The rankings are built once all players are read.
+ *
+ * @param game Pointer to an empty tGame structure.
+ * @param reader Pointer to a reader of the file.
+ * @return true If the count and every record were read.
+ * @return false If the file ends early, or a record is incomplete.
+ */
+bool load_players(pGame game, pReader reader) {
+    char* save_ptr;
+    char* line = reader_next_line(reader);
+    if (line == NULL) {
+        return false;
+    }
+    int num_players = atoi(line);
+    if (num_players <= 0) {
+        return true;
+    }
+    pRegistry registry = &game->registry;
+    registry->capacity = num_players;
+    registry->ids = track_malloc(num_players * sizeof(int));
+    registry->games_played = track_malloc(num_players * sizeof(int));
+    registry->wins = track_malloc(num_players * sizeof(int));
+    registry->name_offsets = track_malloc(num_players * sizeof(size_t));
+    registry->ids_capacity = num_players;
+    registry->index = track_malloc(num_players * sizeof(int));
+    registry->free_ids = track_malloc(num_players * sizeof(int));
+    registry->names_capacity = READER_CHUNK_SIZE;
+    registry->names = track_malloc(registry->names_capacity);
+    for (int i = 0; i < num_players; i++) {
+        line = reader_next_line(reader);
+        char* name = line == NULL ? NULL : strtok_r(line, " ", &save_ptr);
+        char* games_played = name == NULL ? NULL : strtok_r(NULL, " ", &save_ptr);
+        char* wins = games_played == NULL ? NULL : strtok_r(NULL, " ", &save_ptr);
+        if (wins == NULL) {
+            return false;
+        }
+        registry->name_offsets[i] = registry_put_name(registry, name);
+        registry->games_played[i] = atoi(games_played);
+        registry->wins[i] = atoi(wins);
+        registry->ids[i] = i;
+        registry->index[i] = i;
+        registry->num_players++;
+        registry->num_ids++;
+    }
+    ranking_build(&game->wins_ranking, registry->ids, registry->num_players);
+    ranking_build(&game->rate_ranking, registry->ids, registry->num_players);
+    return true;
+}
+
+/**
+ * @brief Loads a game from a file.
+ *
+ * The file must have been written by save_game. A file that ends early, or
+ * whose game does not fit its header, is not loaded.
+ *
+ * @param filename The name of the file.
+ * @return pGame Pointer to a tGame structure, or NULL if the file cannot be
+ * opened or read.
+ */
+pGame load_game(char* filename) {
+    char* save_ptr;
+    FILE* fp = fopen(filename, "r");
+    if (fp == NULL) {
+        return NULL;
+    }
+    pGame game = new_game();
+    tReader reader;
+    init_reader(&reader, fp);
+    bool loaded = load_players(game, &reader);
+    char* line = loaded ? reader_next_line(&reader) : NULL;
+    if (line != NULL && sscanf(line, "%d %d %d", &game->height, &game->width, &game->sequence_size) == 3 && game->height != 0) {
+        loaded = game->height > 0 && game->width > 0 && game->sequence_size > 0;
+
+        // Special sequences
+        line = loaded ? reader_next_line(&reader) : NULL;
+        char* count = line == NULL ? NULL : strtok_r(line, " ", &save_ptr);
+        loaded = count != NULL && atoi(count) >= 0;
+        game->num_special_sequences = loaded ? atoi(count) : 0;
+        game->special_sequences = track_malloc(game->num_special_sequences * sizeof(int));
+        char* special_sequence = loaded ? strtok_r(NULL, " ", &save_ptr) : NULL;
+        int idx = 0;
+        while (special_sequence != NULL && idx < game->num_special_sequences) {
+            game->special_sequences[idx] = atoi(special_sequence);
+            idx++;
+            special_sequence = strtok_r(NULL, " ", &save_ptr);
+        }
+
+        // Players of the current game
+        game->player1 = loaded ? load_in_game_player(game, &reader) : NULL;
+        game->player2 = game->player1 != NULL ? load_in_game_player(game, &reader) : NULL;
+        loaded = game->player2 != NULL;
+
+        // Game board
+        if (!loaded) {
+            game->height = 0;
+        }
+        game->board = track_malloc(game->height * sizeof(pInGamePlayer*));
+        for (int l = 0; l < game->height; l++) {
+            line = loaded ? reader_next_line(&reader) : NULL;
+            loaded = line != NULL;
+            game->board[l] = track_malloc(game->width * sizeof(pInGamePlayer));
+            memset(game->board[l], 0, game->width * sizeof(pInGamePlayer));
+            int c = 0;
+            char* player = loaded ? strtok_r(line, " ", &save_ptr) : NULL;
+            while (player != NULL && c < game->width) {
+                int player_id = atoi(player);
+                if (player_id == 0) {
+                    game->board[l][c] = NULL;
+                } else if (player_id == 1) {
+                    game->board[l][c] = game->player1;
+                } else {
+                    game->board[l][c] = game->player2;
+                }
+                player = strtok_r(NULL, " ", &save_ptr);
+                c++;
+            }
+            loaded = loaded && c == game->width;
+        }
+    }
+    free_reader(&reader);
+    fclose(fp);
+    if (!loaded) {
+        free_game(game);
+        return NULL;
+    }
+    reset_changes(game);
+    if (in_game(game)) {
+        reset_windows(game);
+        select_engine(game);
+    }
+    return game;
+}
+
+/**
+ * @brief Start reading the published state.
+ *
+ * Records the current epoch for the reader, so that blocks retired from now
+ * on are not released while it reads.
+ *
+ * @param slot The index of the spectator.
+ */
+void reader_enter(int slot) {
+    atomic_store(&publication.reader_epochs[slot], atomic_load(&publication.epoch) + 1);
+}
+
+/**
+ * @brief Stop reading the published state.
+ *
+ * @param slot The index of the spectator.
+ */
+void reader_leave(int slot) {
+    atomic_store(&publication.reader_epochs[slot], 0);
+}
+
+/**
+ * @brief Start a sequence lock read.
+ *
+ * @return unsigned The sequence to validate the read with.
+ */
+unsigned read_begin() {
+    unsigned seq;
+    while ((seq = atomic_load(&publication.seq)) & 1) {
+        sched_yield();
+    }
+    return seq;
+}
+
+/**
+ * @brief Check if a sequence lock read must be retried.
+ *
+ * @param seq The sequence returned by read_begin.
+ * @return true If the published state changed during the read.
+ * @return false If the read is consistent.
+ */
+bool read_retry(unsigned seq) {
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load(&publication.seq) != seq;
+}
+
+/**
+ * @brief Comparison function for sorting player records by name.
+ *
+ * @param r1 Pointer to a tPlayerRecord structure.
+ * @param r2 Pointer to a tPlayerRecord structure.
+ * @return int The result of the comparison between player names.
+ */
+int comp_records(const void* r1, const void* r2) {
+    return strcmp(((tPlayerRecord*)r1)->name, ((tPlayerRecord*)r2)->name);
+}
+
+/**
+ * @brief Answer LJ from the published state.
+ *
+ * Readers allocate with malloc, not the tracking allocator, so that they never
+ * take a tracker lock, which the main thread also takes.
+ *
+ * @param out The spectator output.
+ * @param slot The index of the spectator.
+ */
+void spectate_players(FILE* out, int slot) {
+    reader_enter(slot);
+    tPlayerRecord* records = NULL;
+    int capacity = 0;
+    int num_players;
+    unsigned seq;
+    do {
+        seq = read_begin();
+        pRegistryView view = atomic_load(&publication.registry);
+        num_players = view->num_players;
+        if (num_players > capacity) {
+            capacity = num_players;
+            records = realloc(records, sizeof(tPlayerRecord) * capacity);
+        }
+        if (num_players > 0) {
+            memcpy(records, view->records, sizeof(tPlayerRecord) * num_players);
+        }
+    } while (read_retry(seq));
+    if (num_players == 0) {
+        fprintf(out, "Não existem jogadores registados.\n");
+    } else {
+        qsort(records, num_players, sizeof(tPlayerRecord), comp_records);
+        for (int i = 0; i < num_players; i++) {
+            fprintf(out, "%s %d %d\n", records[i].name, records[i].games_played, records[i].wins);
+        }
+    }
+    free(records);
+    reader_leave(slot);
+}
+
+/**
+ * @brief Answer DJ or VR from the published state.
+ *
+ * Allocates with malloc, as spectate_players.
+ *
+ * @param out The spectator output.
+ * @param details True for DJ, false for VR.
+ * @param slot The index of the spectator.
+ */
+void spectate_game(FILE* out, bool details, int slot) {
+    reader_enter(slot);
+    pBoardView view;
+    tBoardView copy = {0};
+    size_t num_cells = 0;
+    unsigned seq;
+    do {
+        seq = read_begin();
+        view = atomic_load(&publication.board);
+        if (view != NULL) {
+            if ((size_t)view->width * view->height > num_cells) {
+                num_cells = (size_t)view->width * view->height;
+                copy.cells = realloc(copy.cells, num_cells);
+            }
+            copy.counts = realloc(copy.counts, sizeof(int) * (2 * view->num_sizes + 1));
+            memcpy(copy.cells, view->cells, (size_t)view->width * view->height);
+            memcpy(copy.counts, view->counts, sizeof(int) * 2 * view->num_sizes);
+        }
+    } while (read_retry(seq));
+    if (view == NULL) {
+        fprintf(out, "Não existe jogo em curso.\n");
+    } else if (details) {
+        fprintf(out, "%d %d\n", view->width, view->height);
+        for (int p = 0; p < 2; p++) {
+            fprintf(out, "%s\n", view->names[p]);
+            for (int i = 0; i < view->num_sizes; i++) {
+                fprintf(out, "%d %d\n", view->sizes[i], copy.counts[p * view->num_sizes + i]);
+            }
+        }
+    } else {
+        for (int r = 0; r < view->height; r++) {
+            for (int c = 0; c < view->width; c++) {
+                uint8_t cell = copy.cells[r * view->width + c];
+                fprintf(out, "%d %d %s\n", r + 1, c + 1, cell == 0 ? "Vazio" : view->names[cell - 1]);
+            }
+        }
+    }
+    free(copy.cells);
+    free(copy.counts);
+    reader_leave(slot);
+}
+
+/**
+ * @brief Spectator thread.
+ *
+ * Answers LJ, DJ and VR instructions read from the spectator input, until a
+ * blank line or the end of the input. Answers reflect the latest state
+ * published by the main thread.
+ *
+ * The thread allocates and releases memory with malloc and free only (see
+ * spectate_players), and its instructions are not tracked by XM.
+ *
+ * @param arg Pointer to a tSpectator structure.
+ * @return void* NULL.
+ */
+void* spectator_main(void* arg) {
+    pSpectator spectator = arg;
+    char* line = NULL;
+    size_t len = 0;
+    while (getline(&line, &len, spectator->in) > 0) {
+        line[strcspn(line, "\n")] = '\0';
+        // strtok keeps global state, which is used by the main thread
+        char* save_ptr;
+        char* command = strtok_r(line, " ", &save_ptr);
+        if (command == NULL) {
+            break;
+        }
+        if (strcmp(command, "LJ") == 0) {
+            spectate_players(spectator->out, spectator->slot);
+        } else if (strcmp(command, "DJ") == 0) {
+            spectate_game(spectator->out, true, spectator->slot);
+        } else if (strcmp(command, "VR") == 0) {
+            spectate_game(spectator->out, false, spectator->slot);
+        } else {
+            fprintf(spectator->out, "Instrução inválida.\n");
+        }
+        fflush(spectator->out);
+    }
+    free(line);
+    fclose(spectator->in);
+    fclose(spectator->out);
+    return NULL;
+}
+
+/**
+ * @brief Start a spectator thread.
+ *
+ * The first spectator enables the publication of the game state. An output
+ * named "-" is kept in memory, and written by stop_spectators once the
+ * spectator finished, so that it never interleaves with the main output.
+ *
+ * @param game Pointer to a tGame structure.
+ * @param input The name of the file with the spectator instructions.
+ * @param output The name of the file for the spectator output, or "-".
+ * @return true If the spectator was started.
+ * @return false If the files could not be opened, or SPECTATORS_MAX
+ * spectators were already started.
+ */
+bool start_spectator(pGame game, char* input, char* output) {
+    if (publication.num_spectators == SPECTATORS_MAX) {
+        return false;
+    }
+    FILE* in = fopen(input, "r");
+    if (in == NULL) {
+        return false;
+    }
+    pSpectator spectator = malloc(sizeof(tSpectator));
+    spectator->buffer = NULL;
+    spectator->size = 0;
+    spectator->out = strcmp(output, "-") == 0 ? open_memstream(&spectator->buffer, &spectator->size) : fopen(output, "w");
+    if (spectator->out == NULL) {
+        fclose(in);
+        free(spectator);
+        return false;
+    }
+    if (!publication.enabled) {
+        publication.enabled = true;
+        publish_registry(game);
+        publish_board(game);
+    }
+    spectator->in = in;
+    spectator->slot = publication.num_spectators;
+    publication.num_spectators++;
+    publication.spectators = track_realloc(publication.spectators, sizeof(pSpectator) * publication.num_spectators);
+    publication.spectators[publication.num_spectators - 1] = spectator;
+    pthread_create(&spectator->thread, NULL, spectator_main, spectator);
+    return true;
+}
+
+/**
+ * @brief Wait for all spectators to finish, and release the published state.
+ *
+ * The outputs kept in memory are written in the order the spectators started.
+ *
+ * @param out The output stream.
+ */
+void stop_spectators(FILE* out) {
+    for (int i = 0; i < publication.num_spectators; i++) {
+        pSpectator spectator = publication.spectators[i];
+        pthread_join(spectator->thread, NULL);
+        if (spectator->buffer != NULL) {
+            fwrite(spectator->buffer, 1, spectator->size, out);
+            free(spectator->buffer);
+        }
+        free(spectator);
+    }
+    track_free(publication.spectators);
+    publication.spectators = NULL;
+    publication.num_spectators = 0;
+    if (publication.enabled) {
+        retire(atomic_exchange(&publication.registry, NULL), release_registry_view);
+        retire(atomic_exchange(&publication.board, NULL), release_board_view);
+        reclaim_retired();
+        publication.enabled = false;
+    }
+}
+
+#define TRACE_MAGIC "IATR1"  ///< Identifies a trace file (with the terminating null).
+
+/**
+ * @brief A captured instruction, as read back from a trace.
+ */
+typedef struct {
+    uint64_t arrival;     ///< Time since the first instruction, in ns.
+    const uint8_t* lines; ///< The input lines, each as a varint length plus one and the bytes.
+    uint64_t latency;     ///< Time to execute the instruction when captured, in ns.
+    uint64_t output_size; ///< The number of bytes of output.
+    uint64_t output_hash; ///< FNV-1a hash of the output.
+} tTraceRecord;
+
+/**
+ * @brief A trace of the instructions of a session.
+ *
+ * When capturing, each instruction is appended to the trace file as a record
+ * with the time since the previous instruction, its input lines (including
+ * the extra lines of IJ and XJ) followed by a 0, its latency and the size and
+ * hash of its output. All integers are varints, and the hash takes 8 bytes.
+ * Lines are written as they are read, so capturing allocates no memory, and
+ * XM reports the same as without a trace.
+ *
+ * When replaying, the input lines of the session are read from the records
+ * instead, each instruction is delayed until its arrival time scaled by the
+ * speed, and the output of each instruction is compared to the captured one.
+ *
+ * In both modes the session writes to a memory stream, which is hashed and
+ * forwarded to the real output after each instruction.
+ */
+typedef struct {
+    bool replay;              ///< Whether the trace is replayed, rather than captured.
+    FILE* out;                ///< Memory stream with the output of the current instruction.
+    char* output;             ///< The bytes of the memory stream.
+    size_t output_size;       ///< The number of bytes of the memory stream.
+    FILE* forward;            ///< The real output of the session.
+    bool in_instruction;      ///< Whether the first line of an instruction was read.
+    uint64_t start;           ///< When the current instruction started, in ns.
+    FILE* file;               ///< The trace file being written, when capturing.
+    uint64_t previous;        ///< When the previous instruction arrived, in ns.
+    const uint8_t* map;       ///< The mapped trace file, when replaying.
+    size_t map_size;          ///< The length of the mapping.
+    const uint8_t* next;      ///< The next record of the mapping.
+    tTraceRecord record;      ///< The record of the current instruction.
+    const uint8_t* next_line; ///< The next input line of the record, or NULL after the last.
+    double speed;             ///< Replay speed, or 0 for as fast as possible.
+    uint64_t replay_start;    ///< When the replay started, in ns.
+    uint64_t* captured;       ///< Latencies of the replayed instructions when captured (untracked).
+    uint64_t* replayed;       ///< Latencies of the replayed instructions (untracked).
+    long num_instructions;    ///< The number of replayed instructions.
+    long capacity;            ///< The number of latencies the arrays can hold.
+    long num_divergences;     ///< The number of instructions whose output differs.
+} tTrace, *pTrace;
+
+/**
+ * @brief Read the monotonic clock.
+ *
+ * @return uint64_t The time, in ns.
+ */
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * @brief FNV-1a hash of some bytes.
+ *
+ * @param bytes The bytes.
+ * @param count The number of bytes.
+ * @return uint64_t The hash.
+ */
+uint64_t hash_bytes(const void* bytes, size_t count) {
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (size_t i = 0; i < count; i++) {
+        hash = (hash ^ ((const uint8_t*)bytes)[i]) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+/**
+ * @brief Read a varint that must end before a given position.
+ *
+ * @param[in,out] p Pointer to the position to read, advanced past the integer.
+ * @param end The end of the readable bytes.
+ * @param[out] value The value read.
+ * @return true If the integer was read.
+ * @return false If the bytes end before the integer.
+ */
+bool read_varint_until(const uint8_t** p, const uint8_t* end, uint64_t* value) {
+    *value = 0;
+    for (int shift = 0; *p < end && shift < 64; shift += 7) {
+        uint8_t byte = *(*p)++;
+        *value |= (uint64_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Write a varint, as buffer_put_varint, to a file.
+ *
+ * @param fp The file.
+ * @param value The value to write.
+ */
+void write_varint(FILE* fp, uint64_t value) {
+    do {
+        fputc((value & 0x7F) | (value >= 0x80 ? 0x80 : 0), fp);
+        value >>= 7;
+    } while (value != 0);
+}
+
+/**
+ * @brief Decode the next record of a replayed trace.
+ *
+ * A truncated record, as left by a capture that did not end normally, ends
+ * the trace.
+ *
+ * @param trace Pointer to a replayed tTrace structure.
+ * @return true If a record was decoded into trace->record.
+ * @return false If there are no more records.
+ */
+bool trace_next_record(pTrace trace) {
+    const uint8_t* p = trace->next;
+    const uint8_t* end = trace->map + trace->map_size;
+    uint64_t delta, length;
+    if (!read_varint_until(&p, end, &delta)) {
+        return false;
+    }
+    trace->record.arrival += delta;
+    trace->record.lines = p;
+    do {
+        if (!read_varint_until(&p, end, &length) || length > (uint64_t)(end - p) + 1) {
+            return false;
+        }
+        p += length > 0 ? length - 1 : 0;
+    } while (length > 0);
+    if (!read_varint_until(&p, end, &trace->record.latency) || !read_varint_until(&p, end, &trace->record.output_size) ||
+        end - p < (ptrdiff_t)sizeof(uint64_t)) {
+        return false;
+    }
+    memcpy(&trace->record.output_hash, p, sizeof(uint64_t));
+    trace->next = p + sizeof(uint64_t);
+    return true;
+}
+
+/**
+ * @brief Start capturing a session to a trace file.
+ *
+ * @param trace Pointer to the tTrace structure to initialize.
+ * @param filename The name of the trace file.
+ * @param forward The real output of the session.
+ * @return true If the trace file was created.
+ * @return false If the trace file could not be created.
+ */
+bool start_capture(pTrace trace, char* filename, FILE* forward) {
+    *trace = (tTrace){0};
+    trace->file = fopen(filename, "wb");
+    if (trace->file == NULL) {
+        return false;
+    }
+    fwrite(TRACE_MAGIC, 1, sizeof(TRACE_MAGIC), trace->file);
+    trace->forward = forward;
+    trace->out = open_memstream(&trace->output, &trace->output_size);
+    return true;
+}
+
+/**
+ * @brief Start replaying a trace file.
+ *
+ * @param trace Pointer to the tTrace structure to initialize.
+ * @param filename The name of the trace file.
+ * @param speed The replay speed, or 0 for as fast as possible.
+ * @param forward The real output of the session.
+ * @return true If the trace file was mapped.
+ * @return false If the trace file could not be read or is not a trace.
+ */
+bool start_replay(pTrace trace, char* filename, double speed, FILE* forward) {
+    *trace = (tTrace){0};
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(TRACE_MAGIC)) {
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED && memcmp(data, TRACE_MAGIC, sizeof(TRACE_MAGIC)) == 0) {
+            trace->map = data;
+            trace->map_size = st.st_size;
+        } else if (data != MAP_FAILED) {
+            munmap(data, st.st_size);
+        }
+    }
+    close(fd);
+    if (trace->map == NULL) {
+        return false;
+    }
+    trace->replay = true;
+    trace->next = trace->map + sizeof(TRACE_MAGIC);
+    trace->speed = speed;
+    trace->forward = forward;
+    trace->out = open_memstream(&trace->output, &trace->output_size);
+    return true;
+}
+
+/**
+ * @brief Read an input line of a session through a trace.
+ *
+ * The first line read after an instruction ends starts a new instruction.
+ * When replaying, it also waits for the arrival time of the instruction.
+ * Like getline, the line keeps its newline, and is allocated with malloc.
+ *
+ * @param trace Pointer to a tTrace structure.
+ * @param in The input of the session, when capturing.
+ * @param[in,out] line The line buffer, as in getline.
+ * @param[in,out] len The size of the line buffer, as in getline.
+ * @return ssize_t The length of the line, or -1 at the end of the input.
+ */
+ssize_t trace_getline(pTrace trace, FILE* in, char** line, size_t* len) {
+    if (!trace->replay) {
+        ssize_t length = getline(line, len, in);
+        if (!trace->in_instruction) {
+            trace->in_instruction = true;
+            trace->start = now_ns();
+            write_varint(trace->file, trace->start - (trace->previous == 0 ? trace->start : trace->previous));
+            trace->previous = trace->start;
+        }
+        if (length > 0) {
+            write_varint(trace->file, length + 1);
+            fwrite(*line, 1, length, trace->file);
+        }
+        return length;
+    }
+    if (!trace->in_instruction) {
+        trace->in_instruction = true;
+        trace->next_line = trace_next_record(trace) ? trace->record.lines : NULL;
+        trace->start = now_ns();
+        if (trace->replay_start == 0) {
+            trace->replay_start = trace->start;
+        }
+        if (trace->speed > 0 && trace->next_line != NULL) {
+            // Instructions that arrive while replay is behind are not delayed further
+            uint64_t arrival = trace->replay_start + (uint64_t)(trace->record.arrival / trace->speed);
+            if (arrival > trace->start) {
+                struct timespec ts = {arrival / 1000000000ull, arrival % 1000000000ull};
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            }
+            trace->start = arrival;
+        }
+    }
+    if (*line == NULL || *len == 0) {
+        *len = 120;
+        *line = malloc(*len);
+    }
+    uint64_t length = trace->next_line == NULL ? 0 : read_varint(&trace->next_line);
+    if (length == 0) {
+        trace->next_line = NULL;
+        (*line)[0] = '\0';
+        return -1;
+    }
+    length--;
+    if (length + 1 > *len) {
+        *len = length + 1;
+        *line = realloc(*line, *len);
+    }
+    memcpy(*line, trace->next_line, length);
+    (*line)[length] = '\0';
+    trace->next_line += length;
+    return length;
+}
+
+/**
+ * @brief End an instruction of a traced session.
+ *
+ * Forwards the output of the instruction, and appends its record to the trace
+ * file or compares it with the captured record.
+ *
+ * @param trace Pointer to a tTrace structure.
+ */
+void trace_end_instruction(pTrace trace) {
+    fflush(trace->out);
+    uint64_t latency = now_ns() - trace->start;
+    uint64_t hash = hash_bytes(trace->output, trace->output_size);
+    fwrite(trace->output, 1, trace->output_size, trace->forward);
+    if (!trace->replay) {
+        write_varint(trace->file, 0);
+        write_varint(trace->file, latency);
+        write_varint(trace->file, trace->output_size);
+        fwrite(&hash, sizeof(hash), 1, trace->file);
+    } else {
+        if (trace->num_instructions == trace->capacity) {
+            trace->capacity = trace->capacity == 0 ? 1024 : trace->capacity * 2;
+            trace->captured = realloc(trace->captured, sizeof(uint64_t) * trace->capacity);
+            trace->replayed = realloc(trace->replayed, sizeof(uint64_t) * trace->capacity);
+        }
+        trace->captured[trace->num_instructions] = trace->record.latency;
+        trace->replayed[trace->num_instructions] = latency;
+        trace->num_instructions++;
+        if (hash != trace->record.output_hash || trace->output_size != trace->record.output_size) {
+            const uint8_t* p = trace->record.lines;
+            uint64_t length = read_varint(&p) - 1;
+            const uint8_t* newline = memchr(p, '\n', length);
+            int shown = newline != NULL ? newline - p : (int)length;
+            printf("Divergência na instrução %ld: %.*s\n", trace->num_instructions, shown, (const char*)p);
+            trace->num_divergences++;
         }
     }
-    return unique_special_sequences;
+    rewind(trace->out);
+    trace->in_instruction = false;
 }
 
 /**
- * @brief Get the in game player object.
+ * @brief Comparison function for sorting unsigned 64-bit integers.
  *
- * This function returns the in game player object for the player with the given
- * name.
+ * @param i1 Pointer to an uint64_t.
+ * @param i2 Pointer to an uint64_t.
+ * @return int The result of the comparison.
+ */
+int comp_uint64(const void* i1, const void* i2) {
+    uint64_t a = *(const uint64_t*)i1;
+    uint64_t b = *(const uint64_t*)i2;
+    return (a > b) - (a < b);
+}
+
+/**
+ * @brief Print the latency percentiles of a replayed trace.
  *
- * An inGamePlayer object is a structure that contains a pointer to the player
- * object and its special sequences.
+ * Percentiles use the nearest rank, and latencies are in microseconds.
  *
- * @param game Pointer to a tGame structure.
- * @param name The name of the player.
- * @return pInGamePlayer Pointer to the in game player object.
+ * @param trace Pointer to a replayed tTrace structure.
  */
-pInGamePlayer get_in_game_player(pGame game, char* name) {
-    if (strcmp(game->player1->player->name, name) == 0) {
-        return game->player1;
+void print_replay_report(pTrace trace) {
+    long n = trace->num_instructions;
+    printf("Instruções: %ld\n", n);
+    printf("Divergências: %ld\n", trace->num_divergences);
+    if (n == 0) {
+        return;
+    }
+    qsort(trace->captured, n, sizeof(uint64_t), comp_uint64);
+    qsort(trace->replayed, n, sizeof(uint64_t), comp_uint64);
+    static const char* labels[] = {"p50", "p90", "p99", "p99.9", "máx"};
+    static const long permilles[] = {500, 900, 990, 999, 1000};
+    printf("Percentil Captura Repetição\n");
+    for (int i = 0; i < 5; i++) {
+        long rank = (permilles[i] * n + 999) / 1000;
+        printf("%s %.1f %.1f\n", labels[i], trace->captured[rank - 1] / 1000.0, trace->replayed[rank - 1] / 1000.0);
     }
-    return game->player2;
 }
 
 /**
- * @brief Get the other InGamePlayer object.
+ * @brief Stop capturing or replaying a trace, and release it.
  *
- * Returns the InGamePlayer object for the player with a different name.
+ * @param trace Pointer to a tTrace structure.
+ */
+void stop_trace(pTrace trace) {
+    fclose(trace->out);
+    free(trace->output);
+    if (trace->file != NULL) {
+        fclose(trace->file);
+    }
+    if (trace->map != NULL) {
+        munmap((void*)trace->map, trace->map_size);
+    }
+    free(trace->captured);
+    free(trace->replayed);
+}
+
+/**
+ * @brief A session of instructions.
+ */
+typedef struct {
+    FILE* in;         ///< The instructions.
+    FILE* out;        ///< The output of the instructions.
+    char* data_file;     ///< The file used by G and L.
+    bool batch;          ///< Whether the session runs in batch mode, without spectators.
+    char* archive_file;  ///< The archive of finished games, or NULL to keep it in memory.
+    pTrace trace;        ///< The trace captured or replayed, or NULL.
+    bool reference;      ///< Whether games always use the reference (generic) engine.
+    pGame game;          ///< The game, while the session runs.
+    tArchive archive;    ///< The archive, while the session runs.
+    char command[8];     ///< The last instruction executed.
+} tSession, *pSession;
+
+/**
+ * @brief Read an input line of a session, as getline.
  *
- * @param game Pointer to a tGame structure.
- * @param name The name of the opposite player.
- * @return pInGamePlayer Pointer to an InGamePlayer object.
+ * @param session Pointer to a tSession structure.
+ * @param[in,out] line The line buffer, as in getline.
+ * @param[in,out] len The size of the line buffer, as in getline.
+ * @return ssize_t The length of the line, or -1 at the end of the input.
  */
-pInGamePlayer get_other_in_game_player(pGame game, char* name) {
-    if (strcmp(game->player1->player->name, name) == 0) {
-        return game->player2;
+ssize_t session_getline(pSession session, char** line, size_t* len) {
+    if (session->trace != NULL) {
+        return trace_getline(session->trace, session->in, line, len);
     }
-    return game->player1;
+    return getline(line, len, session->in);
 }
 
 /**
- * @brief Validate the size of a special sequence.
+ * @brief Start a session, with a new game and the archive of the session.
  *
- * This function validates the size of a special sequence. It returns true if
- * the size is available to the player with the given name.
+ * @param session Pointer to a tSession structure.
+ */
+void open_session(pSession session) {
+    session->game = new_game();
+    session->game->reference = session->reference;
+    open_archive(&session->archive, session->archive_file);
+    session->game->archive = &session->archive;
+}
+
+/**
+ * @brief Executes the next instruction of a session.
  *
- * @param game Pointer to a tGame structure.
- * @param name The name of the player.
- * @param size The size of the special sequence.
- * @return true If the size is available to the player.
- * @return false If the size is not available to the player.
+ * Reads an instruction from the session input, and writes its output to the
+ * session output.
+ *
+ * @param session Pointer to a started tSession structure.
+ * @return true If an instruction was executed.
+ * @return false At a blank line, or the end of the input.
  */
-bool valid_size(pGame game, char* name, int size) {
-    if (size == 1) return true;
-    if (size <= 0) return false;
+bool step_session(pSession session) {
+    pGame game = session->game;
+    FILE* out = session->trace != NULL ? session->trace->out : session->out;
+    char* line = NULL;
+    size_t len = 0;
+    if (session_getline(session, &line, &len) <= 0) {
+        free(line);
+        return false;
+    }
+    line[strlen(line) - 1] = '\0';
+    if (strlen(line) == 0) {
+        free(line);
+        return false;
+    }
+    char* save_ptr;
+    char* command = strtok_r(line, " ", &save_ptr);
+    mem_set_command(command);
+    snprintf(session->command, sizeof(session->command), "%s", command);
+    if (strcmp(command, "RJ") == 0) {
+        char* name = strtok_r(NULL, " ", &save_ptr);
+        if (has_player(game, name)) {
+            fprintf(out, "Jogador existente.\n");
+        } else {
+            add_player(game, name);
+            fprintf(out, "Jogador registado com sucesso.\n");
+        }
+    } else if (strcmp(command, "EJ") == 0) {
+        char* name = strtok_r(NULL, " ", &save_ptr);
+        if (!has_player(game, name)) {
+            fprintf(out, "Jogador não existente.\n");
+        } else if (in_game(game) && player_in_game(game, name)) {
+            fprintf(out, "Jogador participa no jogo em curso.\n");
+        } else {
+            remove_player(game, name);
+            fprintf(out, "Jogador removido com sucesso.\n");
+        }
+    } else if (strcmp(command, "LJ") == 0) {
+        if (!has_players(game)) {
+            fprintf(out, "Não existem jogadores registados.\n");
+        } else {
+            pRegistry registry = &game->registry;
+            int* players = track_malloc(sizeof(int) * registry->num_players);
+            for (int i = 0; i < registry->num_players; i++) {
+                players[i] = i;
+            }
+            sort_registry = registry;
+            qsort(players, registry->num_players, sizeof(int), comp_players);
+            for (int i = 0; i < registry->num_players; i++) {
+                int idx = players[i];
+                fprintf(out, "%s %d %d\n", registry->names + registry->name_offsets[idx], registry->games_played[idx], registry->wins[idx]);
+            }
+            track_free(players);
+        }
+    } else if (strcmp(command, "IJ") == 0) {
+        char* player1_name = strtok_r(NULL, " ", &save_ptr);
+        char* player2_name = strtok_r(NULL, " ", &save_ptr);
+        char* line2 = NULL;
+        size_t len2 = 0;
+        session_getline(session, &line2, &len2);
+        int width = atoi(strtok_r(line2, " ", &save_ptr));
+        int height = atoi(strtok_r(NULL, " ", &save_ptr));
+        int sequence_size = atoi(strtok_r(NULL, " ", &save_ptr));
+        char* line3 = NULL;
+        size_t len3 = 0;
+        session_getline(session, &line3, &len3);
+        char* special_sequence = strtok_r(line3, " ", &save_ptr);
+        int* special_sequences = NULL;
+        int count = 0;
+        while (special_sequence != NULL) {
+            special_sequences = track_realloc(special_sequences, sizeof(int) * (count + 1));
+            special_sequences[count] = atoi(special_sequence);
+            special_sequence = strtok_r(NULL, " ", &save_ptr);
+            count++;
+        }
+        if (in_game(game)) {
+            fprintf(out, "Existe um jogo em curso.\n");
+        } else if (!has_player(game, player1_name) || !has_player(game, player2_name)) {
+            fprintf(out, "Jogador não registado.\n");
+        } else if (!valid_dimensions(width, height)) {
+            fprintf(out, "Dimensões de grelha inválidas.\n");
+        } else if (!valid_sequence(width, sequence_size)) {
+            fprintf(out, "Tamanho de sequência inválido.\n");
+        } else if (!valid_special_sequences(sequence_size, special_sequences, count)) {
+            fprintf(out, "Dimensões de peças especiais inválidas.\n");
+        } else {
+            start_game(game, player1_name, player2_name, width, height, sequence_size, special_sequences, count);
+            if (strcmp(player1_name, player2_name) < 0) {
+                fprintf(out, "Jogo iniciado entre %s e %s.\n", player1_name, player2_name);
+            } else {
+                fprintf(out, "Jogo iniciado entre %s e %s.\n", player2_name, player1_name);
+            }
+        }
+        free(line2);
+        free(line3);
+        track_free(special_sequences);
+    } else if (strcmp(command, "D") == 0) {
+        char* player1_name = strtok_r(NULL, " ", &save_ptr);
+        char* player2_name = strtok_r(NULL, " ", &save_ptr);
+        if (!in_game(game)) {
+            fprintf(out, "Não existe jogo em curso.\n");
+        } else if (!player_in_game(game, player1_name) || (player2_name != NULL && !player_in_game(game, player2_name))) {
+            fprintf(out, "Jogador não participa no jogo em curso.\n");
+        } else {
+            game_over(game, player1_name, player2_name);
+            fprintf(out, "Desistência com sucesso. Jogo terminado.\n");
+        }
+    } else if (strcmp(command, "DJ") == 0) {
+        if (!in_game(game)) {
+            fprintf(out, "Não existe jogo em curso.\n");
+        } else {
+            fprintf(out, "%d %d\n", game->width, game->height);
+            fprintf(out, "%s\n", registry_name(&game->registry, game->player1->player));
+            print_player_special_sequences(out, game, game->player1);
+            fprintf(out, "%s\n", registry_name(&game->registry, game->player2->player));
+            print_player_special_sequences(out, game, game->player2);
+        }
+    } else if (strcmp(command, "CP") == 0) {
+        char* name = strtok_r(NULL, " ", &save_ptr);
+        int size = atoi(strtok_r(NULL, " ", &save_ptr));
+        int column = atoi(strtok_r(NULL, " ", &save_ptr));
+        char* direction = strtok_r(NULL, " ", &save_ptr);
 
-    pInGamePlayer player = get_in_game_player(game, name);
-    for (int i = 0; i < player->num_special_sequences; i++) {
-        if (player->special_sequences[i] == size) {
-            return true;
+        if (!in_game(game)) {
+            fprintf(out, "Não existe jogo em curso.\n");
+        } else if (!player_in_game(game, name)) {
+            fprintf(out, "Jogador não participa no jogo em curso.\n");
+        } else if (!valid_size(game, name, size)) {
+            fprintf(out, "Tamanho de peça não disponível.\n");
+        } else if (!valid_position(game, size, column, direction)) {
+            fprintf(out, "Posição irregular.\n");
+        } else {
+            // Pondering is stale once the board changes
+            pInGamePlayer player = get_in_game_player(game, name);
+            pInGamePlayer other = get_other_in_game_player(game, name);
+            bot_stop(player->bot);
+            bot_stop(other->bot);
+            if (play_piece(out, game, name, size, column, direction)) {
+                if (other->bot != NULL) {
+                    bot_play(out, game, other);
+                } else if (player->bot != NULL) {
+                    bot_ponder(game, player);
+                }
+            }
+        }
+    } else if (strcmp(command, "VR") == 0) {
+        if (!in_game(game)) {
+            fprintf(out, "Não existe jogo em curso.\n");
+        } else {
+            print_board(out, game);
+        }
+    } else if (strcmp(command, "G") == 0) {
+        save_game(game, session->data_file);
+        fprintf(out, "Jogo gravado.\n");
+    } else if (strcmp(command, "L") == 0) {
+        pGame loaded = load_game(session->data_file);
+        if (loaded == NULL) {
+            fprintf(out, "Ocorreu um erro no carregamento.\n");
+        } else {
+            free_game(game);
+            game = loaded;
+            game->archive = &session->archive;
+            game->reference = session->reference;
+            if (in_game(game)) {
+                select_engine(game);
+            }
+            session->game = game;
+            publish_registry(game);
+            publish_board(game);
+            fprintf(out, "Jogo carregado.\n");
+        }
+    } else if (strcmp(command, "XV") == 0 || strcmp(command, "XR") == 0) {
+        char* count = strtok_r(NULL, " ", &save_ptr);
+        char* min_games = strtok_r(NULL, " ", &save_ptr);
+        if (count == NULL || (strcmp(command, "XV") == 0 && min_games != NULL)) {
+            fprintf(out, "Instrução inválida.\n");
+        } else if (!has_players(game)) {
+            fprintf(out, "Não existem jogadores registados.\n");
+        } else {
+            int remaining = atoi(count);
+            if (strcmp(command, "XV") == 0) {
+                print_rank_nodes(out, &game->registry, game->wins_ranking.root, 0, &remaining);
+            } else {
+                print_rank_nodes(out, &game->registry, game->rate_ranking.root, min_games == NULL ? 0 : atoi(min_games), &remaining);
+            }
+        }
+    } else if (strcmp(command, "XP") == 0) {
+        char* name = strtok_r(NULL, " ", &save_ptr);
+        if (name == NULL) {
+            fprintf(out, "Instrução inválida.\n");
+        } else if (!has_player(game, name)) {
+            fprintf(out, "Jogador não existente.\n");
+        } else {
+            int player = get_player(game, name);
+            fprintf(out, "%s %d %d\n", name, ranking_position(&game->wins_ranking, player), ranking_position(&game->rate_ranking, player));
+        }
+    } else if (strcmp(command, "XA") == 0) {
+        if (!in_game(game)) {
+            fprintf(out, "Não existe jogo em curso.\n");
+        } else {
+            tThreats threats1;
+            tThreats threats2;
+            threat_map(game, &threats1, &threats2);
+            print_threats(out, game, game->player1, &threats1);
+            print_threats(out, game, game->player2, &threats2);
+        }
+    } else if (strcmp(command, "XD") == 0) {
+        char* version = strtok_r(NULL, " ", &save_ptr);
+        if (version == NULL) {
+            fprintf(out, "Instrução inválida.\n");
+        } else if (!in_game(game)) {
+            fprintf(out, "Não existe jogo em curso.\n");
+        } else {
+            print_changes(out, game, atol(version));
+        }
+    } else if (strcmp(command, "XJ") == 0) {
+        char* format = strtok_r(NULL, " ", &save_ptr);
+        char* rounds = strtok_r(NULL, " ", &save_ptr);
+        char* bot = strtok_r(NULL, " ", &save_ptr);
+        char* threads = strtok_r(NULL, " ", &save_ptr);
+        char* line2 = NULL;
+        size_t len2 = 0;
+        session_getline(session, &line2, &len2);
+        char* width = strtok_r(line2, " ", &save_ptr);
+        char* height = strtok_r(NULL, " ", &save_ptr);
+        char* sequence_size = strtok_r(NULL, " ", &save_ptr);
+        char* line3 = NULL;
+        size_t len3 = 0;
+        session_getline(session, &line3, &len3);
+        char* special_sequence = strtok_r(line3, " ", &save_ptr);
+        int* special_sequences = NULL;
+        int count = 0;
+        while (special_sequence != NULL) {
+            if (atoi(special_sequence) > 1) {
+                special_sequences = track_realloc(special_sequences, sizeof(int) * (count + 1));
+                special_sequences[count++] = atoi(special_sequence);
+            }
+            special_sequence = strtok_r(NULL, " ", &save_ptr);
+        }
+        if (format == NULL || rounds == NULL || bot == NULL || sequence_size == NULL ||
+            (strcmp(format, "T") != 0 && strcmp(format, "S") != 0) || (strcmp(bot, "A") != 0 && strcmp(bot, "G") != 0) ||
+            atoi(rounds) < 1 || count > TABLEBASE_MAX_SPECIALS) {
+            fprintf(out, "Instrução inválida.\n");
+        } else if (game->registry.num_players < 2) {
+            fprintf(out, "Jogadores insuficientes.\n");
+        } else if (atoi(width) <= 0 || !valid_dimensions(atoi(width), atoi(height))) {
+            fprintf(out, "Dimensões de grelha inválidas.\n");
+        } else if (atoi(sequence_size) <= 0 || !valid_sequence(atoi(width), atoi(sequence_size))) {
+            fprintf(out, "Tamanho de sequência inválido.\n");
+        } else if (!valid_special_sequences(atoi(sequence_size), special_sequences, count)) {
+            fprintf(out, "Dimensões de peças especiais inválidas.\n");
+        } else {
+            tTournament tournament = {0};
+            tournament.width = atoi(width);
+            tournament.height = atoi(height);
+            tournament.sequence_size = atoi(sequence_size);
+            tournament.special_sequences = special_sequences;
+            tournament.num_special_sequences = count;
+            tournament.bot = bot[0];
+            int num_threads = threads != NULL ? atoi(threads) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+            long num_games = run_tournament(game, format[0], atoi(rounds), &tournament, num_threads);
+            fprintf(out, "Torneio terminado com %ld jogos.\n", num_games);
+        }
+        free(line2);
+        free(line3);
+        track_free(special_sequences);
+    } else if (strcmp(command, "XH") == 0) {
+        char* name = strtok_r(NULL, " ", &save_ptr);
+        char* count = strtok_r(NULL, " ", &save_ptr);
+        if (name == NULL || count == NULL) {
+            fprintf(out, "Instrução inválida.\n");
+        } else {
+            print_player_games(out, &session->archive, name, atoi(count));
+        }
+    } else if (strcmp(command, "XC") == 0) {
+        char* name1 = strtok_r(NULL, " ", &save_ptr);
+        char* name2 = strtok_r(NULL, " ", &save_ptr);
+        if (name1 == NULL || name2 == NULL) {
+            fprintf(out, "Instrução inválida.\n");
+        } else {
+            print_head_to_head(out, &session->archive, name1, name2);
+        }
+    } else if (strcmp(command, "XG") == 0) {
+        char* number = strtok_r(NULL, " ", &save_ptr);
+        if (number == NULL) {
+            fprintf(out, "Instrução inválida.\n");
+        } else if (!print_archived_game(out, &session->archive, atol(number))) {
+            fprintf(out, "Jogo não existente.\n");
+        }
+    } else if (strcmp(command, "XT") == 0) {
+        char* name = strtok_r(NULL, " ", &save_ptr);
+        char* filename = strtok_r(NULL, " ", &save_ptr);
+        if (name == NULL) {
+            fprintf(out, "Instrução inválida.\n");
+        } else if (!in_game(game)) {
+            fprintf(out, "Não existe jogo em curso.\n");
+        } else if (!player_in_game(game, name)) {
+            fprintf(out, "Jogador não participa no jogo em curso.\n");
+        } else {
+            static const char* RESULTS[] = {"Posição desconhecida.", "Vitória.", "Derrota.", "Empate."};
+            pInGamePlayer player = get_in_game_player(game, name);
+            tTablebase table = {0};
+            int result = -1;
+            if (filename == NULL) {
+                result = query_tablebase(&tablebase, game, player);
+            } else if (map_tablebase(&table, filename)) {
+                result = query_tablebase(&table, game, player);
+                unmap_tablebase(&table);
+            }
+            fprintf(out, "%s\n", result < 0 ? "Tabela não disponível." : RESULTS[result]);
+        }
+    } else if (strcmp(command, "XB") == 0) {
+        char* name = strtok_r(NULL, " ", &save_ptr);
+        char* budget = strtok_r(NULL, " ", &save_ptr);
+        if (name == NULL || budget == NULL || atol(budget) < 0) {
+            fprintf(out, "Instrução inválida.\n");
+        } else if (!in_game(game)) {
+            fprintf(out, "Não existe jogo em curso.\n");
+        } else if (!player_in_game(game, name)) {
+            fprintf(out, "Jogador não participa no jogo em curso.\n");
+        } else if (game->num_special_sequences > TABLEBASE_MAX_SPECIALS) {
+            fprintf(out, "Bot não disponível.\n");
+        } else {
+            attach_bot(game, get_in_game_player(game, name), atol(budget));
+            fprintf(out, "Bot associado a %s.\n", name);
+        }
+    } else if (strcmp(command, "XS") == 0) {
+        char* input = strtok_r(NULL, " ", &save_ptr);
+        char* output = strtok_r(NULL, " ", &save_ptr);
+        if (input == NULL || output == NULL || session->batch) {
+            fprintf(out, "Instrução inválida.\n");
+        } else if (!start_spectator(game, input, output)) {
+            fprintf(out, "Ocorreu um erro ao iniciar o espectador.\n");
+        } else {
+            fprintf(out, "Espectador iniciado.\n");
+        }
+    } else if (strcmp(command, "XM") == 0) {
+        print_mem_stats(out);
+    } else if (strcmp(command, "X") == 0) {
+        if (!in_game(game)) {
+            fprintf(out, "Não existe jogo em curso.\n");
+        } else {
+            for (int l = 0; l < game->height; l++) {
+                for (int c = 0; c < game->width; c++) {
+                    if (game->board[l][c] != NULL) {
+                        fprintf(out, "%8s", registry_name(&game->registry, game->board[l][c]->player));
+                    } else {
+                        fprintf(out, "%8s", "----");
+                    }
+                }
+                fprintf(out, "\n");
+            }
         }
+    } else {
+        fprintf(out, "Instrução inválida.\n");
     }
-    return false;
+    free(line);
+    reclaim_retired();
+    if (session->trace != NULL) {
+        trace_end_instruction(session->trace);
+    }
+    return true;
 }
 
 /**
- * @brief Get the starting column.
+ * @brief End a session, releasing its game and closing its archive.
  *
- * This function returns the starting column for a sequence of the given size,
- * placed in the given column, and with the given direction.
+ * @param session Pointer to a started tSession structure.
+ */
+void close_session(pSession session) {
+    free_game(session->game);
+    session->game = NULL;
+    close_archive(&session->archive);
+}
+
+/**
+ * @brief Executes the instructions of a session.
  *
- * The stating column is the leftmost column where the sequence would be placed.
+ * Reads instructions from the session input until a blank line, or the end of
+ * the input, and writes their output to the session output.
  *
- * @param size The size of the sequence.
- * @param column The column where the sequence is placed.
- * @param direction The direction of the sequence.
- * @return int The starting (leftmost) column.
+ * @param session Pointer to a tSession structure.
  */
-int get_starting_column(int size, int column, char* direction) {
-    int dir = 1;
-    if (direction != NULL) {
-        dir = strcmp(direction, "D") == 0 ? 0 : -1;
+void run_session(pSession session) {
+    open_session(session);
+    while (step_session(session)) {
     }
-    int col = column - 1;
-    int shift = (size - 1) * dir;
-    return col + shift;
+    close_session(session);
 }
 
 /**
- * @brief Check if a position is valid.
+ * @brief A batch of scripts, shared by the batch threads.
+ */
+typedef struct {
+    char** scripts;        ///< The names of the script files.
+    int num_scripts;       ///< The number of scripts.
+    atomic_int next;       ///< Index of the next script to run.
+    atomic_int failures;   ///< The number of scripts that could not be run.
+} tBatch, *pBatch;
+
+/**
+ * @brief Run a script as an isolated session.
  *
- * This function checks if a position is valid. A position is valid if it is
- * within the board, and if all its pieces could be placed in the first (top)
- * row.
+ * The output is written to the script name followed by ".mine.out", and G and
+ * L use the script name followed by ".data". The session allocates on its own
+ * tracker, with the memory limit of the process, so XM prints what a separate
+ * execution would. The tracker is kept if blocks outlive the session, so that
+ * they can still be released.
  *
- * @param game Pointer to a tGame structure.
- * @param size The size of the sequence.
- * @param column The column where the sequence is placed.
- * @param direction The direction of the sequence.
- * @return bool True if the position is valid, false otherwise.
+ * @param script The name of the script file.
+ * @return true If the script was run.
+ * @return false If the files could not be opened.
  */
-bool valid_position(pGame game, int size, int column, char* direction) {
-    int col = get_starting_column(size, column, direction);
-    if (col < 0 || col + size > game->width) {
-        return false;
-    }
-    for (int c = col; c < col + size; c++) {
-        if (game->board[0][c] != NULL) {
-            return false;
+bool run_script(char* script) {
+    size_t len = strlen(script);
+    char* output = track_malloc(len + sizeof(".mine.out"));
+    char* data_file = track_malloc(len + sizeof(".data"));
+    char* archive_file = track_malloc(len + sizeof(".archive"));
+    sprintf(output, "%s.mine.out", script);
+    sprintf(data_file, "%s.data", script);
+    sprintf(archive_file, "%s.archive", script);
+    FILE* in = fopen(script, "r");
+    FILE* out = in == NULL ? NULL : fopen(output, "w");
+    bool ran = in != NULL && out != NULL;
+    if (ran) {
+        tMemTracker* process_tracker = mem_get_tracker();
+        tMemTracker* tracker = malloc(sizeof(tMemTracker));
+        mem_init_tracker(tracker, mem_get_limit());
+        mem_use_tracker(tracker);
+        tSession session = {.in = in, .out = out, .data_file = data_file, .batch = true, .archive_file = archive_file};
+        run_session(&session);
+        mem_use_tracker(process_tracker);
+        if (tracker->total.live_bytes == 0) {
+            pthread_mutex_destroy(&tracker->lock);
+            free(tracker);
         }
     }
-    return true;
+    if (in != NULL) fclose(in);
+    if (out != NULL) fclose(out);
+    track_free(output);
+    track_free(data_file);
+    track_free(archive_file);
+    return ran;
 }
 
 /**
- * @brief Remove a special sequence from a player.
+ * @brief Batch thread.
  *
- * This function removes a special sequence size instance from a player.
+ * Runs scripts of the batch until all have been taken.
  *
- * @param player Pointer to a tInGamePlayer structure.
- * @param size The size of the special sequence.
+ * @param arg Pointer to a tBatch structure.
+ * @return void* NULL.
  */
-void remove_special_sequence(pInGamePlayer player, int size) {
-    for (int i = 0; i < player->num_special_sequences; i++) {
-        if (player->special_sequences[i] == size) {
-            int offset = player->num_special_sequences - i - 1;
-            memmove(&(player->special_sequences[i]), &(player->special_sequences[i + 1]), offset * sizeof(int));
-            player->num_special_sequences--;
-            break;
+void* batch_main(void* arg) {
+    pBatch batch = arg;
+    int idx;
+    while ((idx = atomic_fetch_add(&batch->next, 1)) < batch->num_scripts) {
+        if (!run_script(batch->scripts[idx])) {
+            fprintf(stderr, "Ocorreu um erro ao executar %s.\n", batch->scripts[idx]);
+            atomic_fetch_add(&batch->failures, 1);
         }
     }
+    return NULL;
 }
 
 /**
- * @brief Drop a sequence.
+ * @brief Run a batch of scripts in parallel.
  *
- * This function drops a sequence of the given size, placed in the given column,
- * and with the given direction.
+ * Each script runs in its own session, with its own game and memory tracker,
+ * as if it was the standard input of a separate execution of the program, with
+ * two exceptions: XS is refused, as the spectators and the published state are
+ * shared by the process, and an allocation beyond the memory limit of a script
+ * ends the whole program.
  *
- * The function returns the placement coordinates of the pieces of the sequence.
- *
- * @param game Pointer to a tGame structure.
- * @param name The name of the player.
- * @param size The size of the sequence.
- * @param column The column where the sequence is placed.
- * @param direction The direction of the sequence.
- * @param[out] lines The line numbers of the pieces of the sequence.
- * @param[out] cols The column numbers of the pieces of the sequence.
+ * @param list The name of a file with the names of the scripts, one per line.
+ * @param num_threads The number of threads.
+ * @return int The number of scripts that could not be run, or -1 if the list
+ * could not be read.
  */
-void drop(pGame game, char* name, int size, int column, char* direction, int* lines, int* columns) {
-    pInGamePlayer player = get_in_game_player(game, name);
-    int col = get_starting_column(size, column, direction);
-    int idx = 0;
-    for (int c = col; c < col + size; c++) {
-        bool placed = false;
-        for (int l = 0; l < game->height && !placed; l++) {
-            if (game->board[l][c] != NULL) {
-                game->board[l - 1][c] = player;
-                lines[idx] = l - 1;
-                columns[idx] = c;
-                placed = true;
-            }
-        }
-        if (!placed) {
-            game->board[game->height - 1][c] = player;
-            lines[idx] = game->height - 1;
-            columns[idx] = c;
+int run_batch(char* list, int num_threads) {
+    FILE* fp = fopen(list, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    tBatch batch = {0};
+    char* line = NULL;
+    size_t len = 0;
+    while (getline(&line, &len, fp) > 0) {
+        line[strcspn(line, "\n")] = '\0';
+        if (strlen(line) > 0) {
+            batch.num_scripts++;
+            batch.scripts = track_realloc(batch.scripts, sizeof(char*) * batch.num_scripts);
+            batch.scripts[batch.num_scripts - 1] = copy_name(line);
         }
     }
-    if (size > 1) {
-        remove_special_sequence(player, size);
+    free(line);
+    fclose(fp);
+    atomic_init(&batch.next, 0);
+    atomic_init(&batch.failures, 0);
+    if (num_threads < 1) num_threads = 1;
+    pthread_t* threads = track_malloc(sizeof(pthread_t) * num_threads);
+    for (int i = 0; i < num_threads; i++) {
+        pthread_create(&threads[i], NULL, batch_main, &batch);
+    }
+    for (int i = 0; i < num_threads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    track_free(threads);
+    for (int i = 0; i < batch.num_scripts; i++) {
+        track_free(batch.scripts[i]);
+    }
+    track_free(batch.scripts);
+    return atomic_load(&batch.failures);
+}
+
+/**
+ * @brief Replay a trace as a session, and report on it.
+ *
+ * The output is written to the trace name followed by ".mine.out", and G and
+ * L use the trace name followed by ".data". The data and archive files are
+ * removed first, so every replay starts from an empty state, as the captured
+ * session is assumed to have. The replay runs as a batch session, so XS
+ * instructions are refused, and reported as divergent.
+ *
+ * @param filename The name of the trace file.
+ * @param speed The replay speed, or 0 for as fast as possible.
+ * @return long The number of divergent instructions, or -1 if the trace could
+ * not be replayed.
+ */
+long replay_trace(char* filename, double speed) {
+    // Untracked, as the latencies, so that XM reports the same as when captured
+    size_t len = strlen(filename);
+    char* output = malloc(len + sizeof(".mine.out"));
+    char* data_file = malloc(len + sizeof(".data"));
+    char* archive_file = malloc(len + sizeof(".archive"));
+    sprintf(output, "%s.mine.out", filename);
+    sprintf(data_file, "%s.data", filename);
+    sprintf(archive_file, "%s.archive", filename);
+    remove(data_file);
+    remove(archive_file);
+    long divergences = -1;
+    tTrace trace;
+    FILE* out = fopen(output, "w");
+    if (out != NULL && start_replay(&trace, filename, speed, out)) {
+        tSession session = {.out = out, .data_file = data_file, .batch = true, .archive_file = archive_file, .trace = &trace};
+        run_session(&session);
+        print_replay_report(&trace);
+        divergences = trace.num_divergences;
+        stop_trace(&trace);
     }
+    if (out != NULL) fclose(out);
+    free(output);
+    free(data_file);
+    free(archive_file);
+    return divergences;
 }
 
 /**
- * @brief Count pieces in a given direction.
+ * @brief Time spent on an instruction by each engine of a differential run.
+ */
+typedef struct {
+    char command[8];         ///< The instruction.
+    long calls;              ///< The number of times it was executed.
+    long capacity;           ///< The number of calls the samples can hold.
+    uint64_t* samples[2];    ///< Time of each call in the reference and candidate sessions, in ns.
+} tDiffTiming;
+
+/**
+ * @brief A differential run of the reference and candidate engines.
  *
- * This function counts the number of pieces of the given player in a given
- * direction, starting from the given line and column.
+ * Each stream of instructions runs in two sessions in lockstep. The reference
+ * session always uses the generic engine, which implements the rules, and the
+ * candidate session selects engines as usual. The session that runs first alternates at every
+ * instruction, so that neither always runs on the caches of the other. After
+ * every instruction, the outputs are compared line by line, and the boards
+ * are compared in VR form.
+ */
+typedef struct {
+    tDiffTiming* timings;   ///< Timing of each instruction seen.
+    int num_timings;        ///< The number of instructions in timings.
+    long num_instructions;  ///< The number of instructions executed.
+    long num_divergences;   ///< The number of streams that diverged.
+} tDifferential, *pDifferential;
+
+static char* DIFF_DATA_FILES[2] = {"diferencial.referencia.data", "diferencial.candidato.data"};
+static char* DIFF_ARCHIVE_FILES[2] = {"diferencial.referencia.archive", "diferencial.candidato.archive"};
+
+/**
+ * @brief State of the random instructions of a differential run.
  *
- * The direction is given by the l_shift and c_shift parameters. For example, to
- * count the number of pieces in the direction of the top-left diagonal, the
- * l_shift and c_shift parameters should be -1 and -1, respectively.
+ * The last game started is remembered, so that most moves are made by its
+ * players, in turn, and within its columns.
+ */
+typedef struct {
+    uint64_t seed;  ///< State of the random choices.
+    int players[2]; ///< Index in the names of the players of the last game started.
+    int turn;       ///< Which of the players moves next.
+    int width;      ///< The width of the board of the last game started.
+} tDiffGenerator, *pDiffGenerator;
+
+/**
+ * @brief Append a random instruction to a script.
  *
- * @param game Pointer to a tGame structure.
- * @param player Pointer to a tInGamePlayer structure.
- * @param line The line where the counting starts.
- * @param column The column where the counting starts.
- * @param l_shift The line shift.
- * @param c_shift The column shift.
- * @return int The number of pieces in the given direction.
+ * Instructions are mostly valid, and games mostly use the dimensions of a
+ * specialized engine, so that the specialized engines are exercised. XJ, XB,
+ * XM and XS are left out, as they are slow or depend on timing. New games
+ * end the last game and register their players first.
+ *
+ * @param fp The script.
+ * @param gen Pointer to a tDiffGenerator structure.
  */
-int count_pieces(pGame game, pInGamePlayer player, int line, int column, int l_shift, int c_shift) {
-    int count = 0;
-    int l = line;
-    int c = column;
-    while (l >= 0 && l < game->height && c >= 0 && c < game->width && game->board[l][c] == player) {
-        if (!(l == line && c == column)) {
-            count++;
+void random_instruction(FILE* fp, pDiffGenerator gen) {
+    static const char* NAMES[] = {"Ana", "Bruno", "Carla", "Duarte"};
+    static const char* DIRECTIONS[] = {"", " D", " E"};
+    uint64_t r[8];
+    for (int i = 0; i < 8; i++) {
+        r[i] = gen->seed = splitmix64(gen->seed);
+    }
+    const char* name = NAMES[r[1] % 4];
+    int kind = r[0] % 100;
+    if (kind < 64) {
+        int size = r[2] % 8 == 0 ? 1 + r[3] % 5 : 1;
+        int column = 1 + r[4] % gen->width;
+        if (r[6] % 10 == 0) {
+            column = r[4] % 17;
+        } else {
+            name = NAMES[gen->players[gen->turn]];
+            gen->turn ^= 1;
         }
-        l += l_shift;
-        c += c_shift;
+        fprintf(fp, "CP %s %d %d%s\n", name, size, column, size > 1 ? DIRECTIONS[r[5] % 3] : "");
+    } else if (kind < 67) {
+        fprintf(fp, "RJ %s\n", name);
+    } else if (kind < 72) {
+        int width, height, sequence_size;
+        bool specialized = r[2] % 10 < 7;
+        if (specialized) {
+            const tEngine* engine = &ENGINES[r[3] % (sizeof(ENGINES) / sizeof(ENGINES[0]))];
+            width = engine->width;
+            height = engine->height;
+            sequence_size = engine->sequence_size;
+        } else {
+            width = 1 + r[3] % 16;
+            height = 1 + r[4] % 12;
+            sequence_size = 1 + r[5] % 8;
+        }
+        // End the last game and register the players first, or most games would not start
+        fprintf(fp, "D %s\nRJ %s\nRJ %s\n", NAMES[gen->players[0]], name, NAMES[r[6] % 4]);
+        gen->players[0] = r[1] % 4;
+        gen->players[1] = r[6] % 4;
+        gen->turn = 0;
+        gen->width = width;
+        fprintf(fp, "IJ %s %s\n%d %d %d\n", name, NAMES[gen->players[1]], width, height, sequence_size);
+        for (int i = r[7] % 4; i > 0; i--) {
+            gen->seed = splitmix64(gen->seed);
+            fprintf(fp, "%d%s", (int)(1 + gen->seed % (specialized ? sequence_size - 1 : 6)), i > 1 ? " " : "");
+        }
+        fprintf(fp, "\n");
+    } else if (kind < 73) {
+        fprintf(fp, "D %s\n", name);
+    } else if (kind < 74) {
+        fprintf(fp, "EJ %s\n", name);
+    } else if (kind < 86) {
+        static const char* QUERIES[] = {"VR", "DJ", "LJ", "X", "XA", "G", "L"};
+        fprintf(fp, "%s\n", QUERIES[r[2] % 7]);
+    } else if (kind < 89) {
+        fprintf(fp, "XD %d\n", (int)(r[2] % 64));
+    } else if (kind < 91) {
+        fprintf(fp, "XV %d\n", (int)(r[2] % 5));
+    } else if (kind < 93) {
+        fprintf(fp, "XR %d %d\n", (int)(r[2] % 5), (int)(r[3] % 3));
+    } else if (kind < 95) {
+        fprintf(fp, "XP %s\n", name);
+    } else if (kind < 97) {
+        fprintf(fp, "XH %s %d\n", name, (int)(r[2] % 4));
+    } else if (kind < 98) {
+        fprintf(fp, "XC %s %s\n", name, NAMES[r[2] % 4]);
+    } else {
+        fprintf(fp, "XG %d\n", (int)(r[2] % 8));
     }
-    return count;
 }
 
 /**
- * @brief Check if a player won the game.
+ * @brief Compare the output of the two sessions of a differential run.
  *
- * This function checks if the given player wins. The player wins if he has a
- * sequence equal to or greater than the number of pieces required to win. The
- * given line and column indicate one of the positions recently placed by the
- * player.
+ * Prints the first line that differs.
  *
- * @param game Pointer to a tGame structure.
- * @param name The name of the player.
- * @param line The line where the piece was placed.
- * @param column The column where the piece was placed.
- * @return bool True if the player wins, false otherwise.
+ * @param outputs The outputs of the reference and candidate sessions.
+ * @param sizes The sizes of the outputs.
+ * @return true If the outputs are the same.
  */
-bool player_wins(pGame game, char* name, int line, int column) {
-    pInGamePlayer player = get_in_game_player(game, name);
-    // -1,-1 |       -1,0      | -1,+1
-    // --------------------------------
-    //  0,-1 |   line,column   |  0,+1
-    // --------------------------------
-    // +1,+1 |       +1,0      | -1,0
-    for (int l_shift = 0; l_shift <= 1; l_shift++) {
-        for (int c_shift = 0; c_shift <= 1; c_shift++) {
-            if (l_shift == 0 && c_shift == 0) {
-                continue;
-            }
-            int start_segment = count_pieces(game, player, line, column, l_shift, c_shift);
-            int end_segment = count_pieces(game, player, line, column, -l_shift, -c_shift);
-            if ((start_segment + 1 + end_segment) >= game->sequence_size) {
-                return true;
-            }
+bool compare_outputs(char** outputs, size_t* sizes) {
+    const char* p[2] = {outputs[0], outputs[1]};
+    const char* end[2] = {outputs[0] + sizes[0], outputs[1] + sizes[1]};
+    while (p[0] < end[0] || p[1] < end[1]) {
+        size_t length[2];
+        for (int i = 0; i < 2; i++) {
+            const char* newline = memchr(p[i], '\n', end[i] - p[i]);
+            length[i] = newline != NULL ? (size_t)(newline - p[i]) : (size_t)(end[i] - p[i]);
+        }
+        if (length[0] != length[1] || memcmp(p[0], p[1], length[0]) != 0 || (p[0] < end[0]) != (p[1] < end[1])) {
+            printf("Referência: %.*s\n", (int)length[0], p[0] < end[0] ? p[0] : "(nada)");
+            printf("Candidato: %.*s\n", (int)length[1], p[1] < end[1] ? p[1] : "(nada)");
+            return false;
+        }
+        for (int i = 0; i < 2; i++) {
+            p[i] += p[i] + length[i] < end[i] ? length[i] + 1 : length[i];
         }
     }
-    return false;
+    return true;
 }
 
 /**
- * @brief Terminates the current game.
- *
- * This function terminates the current game. The function should be called when
- * a player wins or when the game is a draw.
+ * @brief Add the time of an instruction to a differential run.
  *
- * The second_name parameter may be NULL if one of the players wins. If the game
- * is a draw, no player records a win.
- *
- * @param game Pointer to a tGame structure.
- * @param first_name The name of the first player.
- * @param second_name The name of the second player.
+ * @param diff Pointer to a tDifferential structure.
+ * @param command The instruction.
+ * @param times Time spent by the reference and candidate sessions, in ns.
  */
-void game_over(pGame game, char* first_name, char* second_name) {
-    pInGamePlayer player = get_in_game_player(game, first_name);
-    if (second_name == NULL) {
-        get_other_in_game_player(game, first_name)->player->wins++;
+void add_diff_timing(pDifferential diff, const char* command, const uint64_t* times) {
+    int i = 0;
+    while (i < diff->num_timings && strcmp(diff->timings[i].command, command) != 0) i++;
+    if (i == diff->num_timings) {
+        diff->num_timings++;
+        diff->timings = track_realloc(diff->timings, sizeof(tDiffTiming) * diff->num_timings);
+        diff->timings[i] = (tDiffTiming){0};
+        snprintf(diff->timings[i].command, sizeof(diff->timings[i].command), "%s", command);
     }
-
-    game->player1->player->games_played++;
-    game->player2->player->games_played++;
-
-    for (int l = 0; l < game->height; l++) {
-        free(game->board[l]);
+    tDiffTiming* timing = &diff->timings[i];
+    if (timing->calls == timing->capacity) {
+        timing->capacity = timing->capacity == 0 ? 64 : timing->capacity * 2;
+        for (int s = 0; s < 2; s++) {
+            timing->samples[s] = track_realloc(timing->samples[s], sizeof(uint64_t) * timing->capacity);
+        }
     }
-    free(game->board);
-    game->board = NULL;
-
-    free(game->special_sequences);
-    game->special_sequences = NULL;
-
-    free(game->player1->special_sequences);
-    free(game->player2->special_sequences);
-    free(game->player1);
-    free(game->player2);
-    game->player1 = NULL;
-    game->player2 = NULL;
+    timing->samples[0][timing->calls] = times[0];
+    timing->samples[1][timing->calls] = times[1];
+    timing->calls++;
 }
 
 /**
- * @brief Prints the number of special sequences of a given player.
+ * @brief Run a stream of instructions through the reference and candidate
+ * sessions in lockstep.
  *
- * @param game Pointer to a tGame structure.
- * @param name The name of the player.
- * @return int The number of special sequences of the given player.
+ * The stream stops at its first divergence. XM is executed but its output
+ * is not compared, as both sessions share the memory statistics.
+ *
+ * @param diff Pointer to a tDifferential structure.
+ * @param script The instructions.
+ * @param size The number of bytes of the instructions.
+ * @param label The name of the stream, for the report.
+ * @return true If the sessions did not diverge.
  */
-void print_player_special_sequences(pGame game, pInGamePlayer player) {
-    int num_unique_special_sequences;
-    int* unique_special_sequences = get_unique_special_sequences(game, &num_unique_special_sequences);
-    for (int i = 0; i < num_unique_special_sequences; i++) {
-        int count = 0;
-        for (int j = 0; j < player->num_special_sequences; j++) {
-            if (player->special_sequences[j] == unique_special_sequences[i]) {
-                count++;
+bool run_differential_stream(pDifferential diff, char* script, size_t size, const char* label) {
+    tSession sessions[2];
+    char* outputs[2];
+    size_t sizes[2];
+    char* boards[2];
+    size_t board_sizes[2];
+    FILE* board_outs[2];
+    for (int i = 0; i < 2; i++) {
+        remove(DIFF_DATA_FILES[i]);
+        remove(DIFF_ARCHIVE_FILES[i]);
+        sessions[i] = (tSession){.in = fmemopen(script, size, "r"), .out = open_memstream(&outputs[i], &sizes[i]),
+                                 .data_file = DIFF_DATA_FILES[i], .batch = true, .archive_file = DIFF_ARCHIVE_FILES[i],
+                                 .reference = i == 0};
+        board_outs[i] = open_memstream(&boards[i], &board_sizes[i]);
+        open_session(&sessions[i]);
+    }
+    bool same = true;
+    for (long step = 1; same; step++) {
+        bool ran[2];
+        uint64_t times[2];
+        for (int k = 0; k < 2; k++) {
+            int i = k ^ (int)(step % 2);
+            uint64_t start = now_ns();
+            ran[i] = step_session(&sessions[i]);
+            times[i] = now_ns() - start;
+            fflush(sessions[i].out);
+            rewind(board_outs[i]);
+            if (ran[i] && in_game(sessions[i].game)) {
+                print_board(board_outs[i], sessions[i].game);
             }
+            fflush(board_outs[i]);
+        }
+        if (!ran[0] && !ran[1]) {
+            break;
+        }
+        diff->num_instructions++;
+        const char* command = sessions[0].command;
+        if (ran[0] != ran[1] || (strcmp(command, "XM") != 0 && !compare_outputs(outputs, sizes))) {
+            printf("Divergência em %s, instrução %ld (%s).\n", label, step, command);
+            same = false;
+        } else if (board_sizes[0] != board_sizes[1] || memcmp(boards[0], boards[1], board_sizes[0]) != 0) {
+            printf("Tabuleiro divergente em %s, instrução %ld (%s).\n", label, step, command);
+            same = false;
+        }
+        add_diff_timing(diff, command, times);
+        for (int i = 0; i < 2; i++) {
+            rewind(sessions[i].out);
         }
-        printf("%d %d\n", unique_special_sequences[i], count);
     }
-    free(unique_special_sequences);
+    for (int i = 0; i < 2; i++) {
+        close_session(&sessions[i]);
+        fclose(sessions[i].in);
+        fclose(sessions[i].out);
+        fclose(board_outs[i]);
+        free(outputs[i]);
+        free(boards[i]);
+        remove(DIFF_DATA_FILES[i]);
+        remove(DIFF_ARCHIVE_FILES[i]);
+    }
+    diff->num_divergences += !same;
+    return same;
 }
 
 /**
- * @brief Saves the game to a file.
+ * @brief Read a recorded stream of instructions.
+ *
+ * The stream is either a script, or a trace captured with "-c".
  *
- * @param game Pointer to a tGame structure.
  * @param filename The name of the file.
+ * @param[out] size The number of bytes of the instructions.
+ * @return char* The instructions, allocated with malloc, or NULL if the file
+ * could not be read.
  */
-void save_game(pGame game, char* filename) {
-    FILE* fp = fopen(filename, "w");
-    fprintf(fp, "%d\n", game->num_players);
-    for (int i = 0; i < game->num_players; i++) {
-        fprintf(fp, "%s %d %d\n", game->players[i]->name, game->players[i]->games_played, game->players[i]->wins);
-    }
-    if (in_game(game)) {
-        fprintf(fp, "%d %d %d\n", game->height, game->width, game->sequence_size);
-        fprintf(fp, "%d ", game->num_special_sequences);
-        for (int i = 0; i < game->num_special_sequences; i++) {
-            fprintf(fp, "%d ", game->special_sequences[i]);
-        }
-        fprintf(fp, "\n");
-        fprintf(fp, "%s ", game->player1->player->name);
-        for (int i = 0; i < game->player1->num_special_sequences; i++) {
-            fprintf(fp, "%d ", game->player1->special_sequences[i]);
+char* read_recorded_stream(char* filename, size_t* size) {
+    char* script = NULL;
+    FILE* out = open_memstream(&script, size);
+    tTrace trace;
+    if (start_replay(&trace, filename, 0, NULL)) {
+        while (trace_next_record(&trace)) {
+            const uint8_t* p = trace.record.lines;
+            for (uint64_t length; (length = read_varint(&p)) > 0; p += length - 1) {
+                fwrite(p, 1, length - 1, out);
+            }
         }
-        fprintf(fp, "\n");
-        fprintf(fp, "%s ", game->player2->player->name);
-        for (int i = 0; i < game->player2->num_special_sequences; i++) {
-            fprintf(fp, "%d ", game->player2->special_sequences[i]);
+        stop_trace(&trace);
+    } else {
+        FILE* fp = fopen(filename, "r");
+        if (fp == NULL) {
+            fclose(out);
+            free(script);
+            return NULL;
         }
-        fprintf(fp, "\n");
-        for (int l = 0; l < game->height; l++) {
-            for (int c = 0; c < game->width; c++) {
-                if (game->board[l][c] == NULL) {
-                    fprintf(fp, "0 ");
-                } else if (game->board[l][c] == game->player1) {
-                    fprintf(fp, "1 ");
-                } else {
-                    fprintf(fp, "2 ");
-                }
-            }
-            fprintf(fp, "\n");
+        char buffer[4096];
+        size_t count;
+        while ((count = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+            fwrite(buffer, 1, count, out);
         }
+        fclose(fp);
     }
-    fclose(fp);
+    fclose(out);
+    return script;
 }
 
 /**
- * @brief Loads the record of a player in the current game from a file.
- *
- * This function allocates memory for the player. The caller is responsible for
- * freeing the memory.
+ * @brief Comparison function for sorting timings by instruction.
  *
- * @param game Pointer to a tGame structure.
- * @param fp Pointer to a file.
- * @return Pointer to a tInGamePlayer structure.
+ * @param t1 Pointer to a tDiffTiming structure.
+ * @param t2 Pointer to a tDiffTiming structure.
+ * @return int The result of the comparison between the instructions.
  */
-pInGamePlayer load_in_game_player(pGame game, FILE* fp) {
-    pInGamePlayer player = malloc(sizeof(tInGamePlayer));
-    player->num_special_sequences = 0;
-    player->special_sequences = NULL;
-    char* line = NULL;
-    size_t len = 0;
-    getline(&line, &len, fp);
-    char* player_name = strtok(line, " ");
-    player->player = get_player(game, player_name);
-    char* special_sequence = strtok(NULL, " ");
-    while (special_sequence != NULL && strcmp(special_sequence, " ") != 0) {
-        player->num_special_sequences++;
-        player->special_sequences = realloc(player->special_sequences, player->num_special_sequences * sizeof(int));
-        player->special_sequences[player->num_special_sequences - 1] = atoi(special_sequence);
-        special_sequence = strtok(NULL, " ");
-    }
-    free(line);
-    return player;
+int comp_diff_timings(const void* t1, const void* t2) {
+    return strcmp(((const tDiffTiming*)t1)->command, ((const tDiffTiming*)t2)->command);
 }
 
 /**
- * @brief Loads a game from a file.
+ * @brief Run the differential harness.
  *
- * @param filename The name of the file.
- * @return pGame Pointer to a tGame structure.
+ * Runs a random stream of Instruções instructions generated from Semente, and
+ * then each recorded stream, and reports the divergences and the median time
+ * per call of each instruction in each engine, in microseconds, with the
+ * speedup of the candidate.
+ *
+ * @param argc The number of arguments.
+ * @param argv Semente, Instruções, and the recorded streams.
+ * @return int 0 if no stream diverged.
  */
-pGame load_game(char* filename) {
-    FILE* fp = fopen(filename, "r");
-    pGame game = new_game();
-    fscanf(fp, "%d\n", &game->num_players);
-    game->players = malloc(game->num_players * sizeof(pPlayer));
-    char* line = NULL;
-    size_t len = 0;
-    for (int i = 0; i < game->num_players; i++) {
-        game->players[i] = malloc(sizeof(tPlayer));
-        getline(&line, &len, fp);
-        char* name = strtok(line, " ");
-        game->players[i]->name = malloc((strlen(name) + 1) * sizeof(char));
-        strcpy(game->players[i]->name, name);
-        game->players[i]->games_played = atoi(strtok(NULL, " "));
-        game->players[i]->wins = atoi(strtok(NULL, " "));
-        free(line);
-        line = NULL;
+int run_differential(int argc, char** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "Utilização: -d Semente Instruções [Ficheiro...]\n");
+        return 1;
     }
-    fscanf(fp, "%d %d %d\n", &game->height, &game->width, &game->sequence_size);
-    if (game->height != 0) {
-        char* row_contents = NULL;
-        size_t row_len = 0;
-
-        // Special sequences
-        getline(&row_contents, &row_len, fp);
-        row_contents[strlen(row_contents) - 1] = '\0';
-        game->num_special_sequences = atoi(strtok(row_contents, " "));
-        game->special_sequences = malloc(game->num_special_sequences * sizeof(int));
-        char* special_sequence = strtok(NULL, " ");
-        int idx = 0;
-        while (special_sequence != NULL && strcmp(special_sequence, " ") != 0) {
-            game->special_sequences[idx] = atoi(special_sequence);
-            idx++;
-            special_sequence = strtok(NULL, " ");
+    tDifferential diff = {0};
+    tDiffGenerator gen = {.seed = strtoull(argv[0], NULL, 10), .players = {0, 1}, .width = 7};
+    long num_instructions = atol(argv[1]);
+    if (num_instructions > 0) {
+        char* script = NULL;
+        size_t size;
+        FILE* fp = open_memstream(&script, &size);
+        for (long i = 0; i < num_instructions; i++) {
+            random_instruction(fp, &gen);
         }
-        free(row_contents);
-        row_contents = NULL;
-
-        // Players of the current game
-        game->player1 = load_in_game_player(game, fp);
-        game->player2 = load_in_game_player(game, fp);
-
-        // Game board
-        game->board = malloc(game->height * sizeof(pInGamePlayer*));
-        for (int l = 0; l < game->height; l++) {
-            getline(&row_contents, &row_len, fp);
-            row_contents[strlen(row_contents) - 1] = '\0';
-            game->board[l] = malloc(game->width * sizeof(pInGamePlayer));
-            int c = 0;
-            char* player = strtok(row_contents, " ");
-            while (player != NULL) {
-                int player_id = atoi(player);
-                if (player_id == 0) {
-                    game->board[l][c] = NULL;
-                } else if (player_id == 1) {
-                    game->board[l][c] = game->player1;
-                } else {
-                    game->board[l][c] = game->player2;
-                }
-                player = strtok(NULL, " ");
-                c++;
-            }
-            free(row_contents);
-            row_contents = NULL;
+        fclose(fp);
+        run_differential_stream(&diff, script, size, "aleatório");
+        free(script);
+    }
+    int failures = 0;
+    for (int i = 2; i < argc; i++) {
+        size_t size;
+        char* script = read_recorded_stream(argv[i], &size);
+        if (script == NULL) {
+            fprintf(stderr, "Ocorreu um erro ao ler %s.\n", argv[i]);
+            failures++;
+            continue;
         }
+        run_differential_stream(&diff, script, size, argv[i]);
+        free(script);
     }
-    fclose(fp);
-    return game;
+    printf("Instruções: %ld\n", diff.num_instructions);
+    printf("Divergências: %ld\n", diff.num_divergences);
+    qsort(diff.timings, diff.num_timings, sizeof(tDiffTiming), comp_diff_timings);
+    printf("Instrução Chamadas Referência Candidato Aceleração\n");
+    for (int i = 0; i < diff.num_timings; i++) {
+        tDiffTiming* timing = &diff.timings[i];
+        uint64_t medians[2];
+        for (int s = 0; s < 2; s++) {
+            qsort(timing->samples[s], timing->calls, sizeof(uint64_t), comp_uint64);
+            medians[s] = timing->samples[s][(timing->calls - 1) / 2];
+            track_free(timing->samples[s]);
+        }
+        printf("%s %ld %.1f %.1f %.2f\n", timing->command, timing->calls, medians[0] / 1000.0, medians[1] / 1000.0,
+               medians[1] > 0 ? (double)medians[0] / medians[1] : 1.0);
+    }
+    track_free(diff.timings);
+    return diff.num_divergences == 0 && failures == 0 ? 0 : 1;
 }
 
 /**
  * @brief Executes the program.
  *
+ * Without arguments, executes the instructions of the standard input. With
+ * "-b Lista [Threads]", runs the scripts named in Lista in parallel, by default
+ * with one thread per processor. With "-t Ficheiro ...", generates a tablebase
+ * (see generate_tablebase). The tablebase in TABLEBASE_FILE, if any, is mapped
+ * for the XT instruction, which may also name another tablebase to look up, as
+ * in "XT Jogador Tabela".
+ *
+ * With "-c Traço", executes the instructions of the standard input and captures
+ * them to Traço. With "-r Traço [Velocidade]", replays Traço at Velocidade times
+ * the captured pace (1 by default, "max" for as fast as possible), and reports
+ * latencies and divergent outputs (see replay_trace). With "-d Semente
+ * Instruções [Ficheiro...]", compares the reference and candidate engines (see
+ * run_differential).
+ *
+ * All modes may be preceded by "-m Bytes", which limits the live bytes of the
+ * tracked allocations, separately for each batch script. An allocation beyond
+ * the limit ends the program.
+ *
+ * The instructions of the standard input keep the archive of finished games in
+ * memory, unless "-a Arquivo" names a file to keep it in, which then precedes
+ * "-c Traço", if any. Batch scripts and traces have their own archive files.
+ *
+ * @param argc The number of arguments.
+ * @param argv The arguments.
  * @return int 0 if the program terminates successfully.
  */
-int main() {
-    pGame game = new_game();
-
-    char* line = NULL;
-    size_t len = 0;
-
-    while (true) {
-        getline(&line, &len, stdin);
-        line[strlen(line) - 1] = '\0';
-        if (strlen(line) == 0) {
-            break;
+int main(int argc, char** argv) {
+    if (argc >= 3 && strcmp(argv[1], "-m") == 0) {
+        if (!MEM_TRACKING) {
+            fprintf(stderr, "Monitorização de memória desativada.\n");
         }
-        char* command = strtok(line, " ");
-        if (strcmp(command, "RJ") == 0) {
-            char* name = strtok(NULL, " ");
-            if (has_player(game, name)) {
-                printf("Jogador existente.\n");
-            } else {
-                add_player(game, name);
-                printf("Jogador registado com sucesso.\n");
-            }
-        } else if (strcmp(command, "EJ") == 0) {
-            char* name = strtok(NULL, " ");
-            if (!has_player(game, name)) {
-                printf("Jogador não existente.\n");
-            } else if (in_game(game) && player_in_game(game, name)) {
-                printf("Jogador participa no jogo em curso.\n");
-            } else {
-                remove_player(game, name);
-                printf("Jogador removido com sucesso.\n");
-            }
-        } else if (strcmp(command, "LJ") == 0) {
-            if (!has_players(game)) {
-                printf("Não existem jogadores registados.\n");
-            } else {
-                pPlayer* players = malloc(sizeof(pPlayer) * game->num_players);
-                memcpy(players, game->players, sizeof(pPlayer) * game->num_players);
-                qsort(players, game->num_players, sizeof(pPlayer), (int (*)(const void*, const void*))comp_players);
-                for (int i = 0; i < game->num_players; i++) {
-                    printf("%s %d %d\n", players[i]->name, players[i]->games_played, players[i]->wins);
-                }
-                free(players);
-            }
-        } else if (strcmp(command, "IJ") == 0) {
-            char* player1_name = strtok(NULL, " ");
-            char* player2_name = strtok(NULL, " ");
-            char* line2 = NULL;
-            size_t len2 = 0;
-            getline(&line2, &len2, stdin);
-            int width = atoi(strtok(line2, " "));
-            int height = atoi(strtok(NULL, " "));
-            int sequence_size = atoi(strtok(NULL, " "));
-            char* line3 = NULL;
-            size_t len3 = 0;
-            getline(&line3, &len3, stdin);
-            char* special_sequence = strtok(line3, " ");
-            int* special_sequences = NULL;
-            int count = 0;
-            while (special_sequence != NULL) {
-                special_sequences = realloc(special_sequences, sizeof(int) * (count + 1));
-                special_sequences[count] = atoi(special_sequence);
-                special_sequence = strtok(NULL, " ");
-                count++;
-            }
-            if (in_game(game)) {
-                printf("Existe um jogo em curso.\n");
-            } else if (!has_player(game, player1_name) || !has_player(game, player2_name)) {
-                printf("Jogador não registado.\n");
-            } else if (!valid_dimensions(width, height)) {
-                printf("Dimensões de grelha inválidas.\n");
-            } else if (!valid_sequence(width, sequence_size)) {
-                printf("Tamanho de sequência inválido.\n");
-            } else if (!valid_special_sequences(sequence_size, special_sequences, count)) {
-                printf("Dimensões de peças especiais inválidas.\n");
-            } else {
-                start_game(game, player1_name, player2_name, width, height, sequence_size, special_sequences, count);
-                if (strcmp(player1_name, player2_name) < 0) {
-                    printf("Jogo iniciado entre %s e %s.\n", player1_name, player2_name);
-                } else {
-                    printf("Jogo iniciado entre %s e %s.\n", player2_name, player1_name);
-                }
-            }
-            free(line2);
-            free(line3);
-            free(special_sequences);
-        } else if (strcmp(command, "D") == 0) {
-            char* player1_name = strtok(NULL, " ");
-            char* player2_name = strtok(NULL, " ");
-            if (!in_game(game)) {
-                printf("Não existe jogo em curso.\n");
-            } else if (!player_in_game(game, player1_name) || (player2_name != NULL && !player_in_game(game, player2_name))) {
-                printf("Jogador não participa no jogo em curso.\n");
-            } else {
-                game_over(game, player1_name, player2_name);
-                printf("Desistência com sucesso. Jogo terminado.\n");
-            }
-        } else if (strcmp(command, "DJ") == 0) {
-            if (!in_game(game)) {
-                printf("Não existe jogo em curso.\n");
-            } else {
-                printf("%d %d\n", game->width, game->height);
-                printf("%s\n", game->player1->player->name);
-                print_player_special_sequences(game, game->player1);
-                printf("%s\n", game->player2->player->name);
-                print_player_special_sequences(game, game->player2);
-            }
-        } else if (strcmp(command, "CP") == 0) {
-            char* name = strtok(NULL, " ");
-            int size = atoi(strtok(NULL, " "));
-            int column = atoi(strtok(NULL, " "));
-            char* direction = strtok(NULL, " ");
-
-            if (!in_game(game)) {
-                printf("Não existe jogo em curso.\n");
-            } else if (!player_in_game(game, name)) {
-                printf("Jogador não participa no jogo em curso.\n");
-            } else if (!valid_size(game, name, size)) {
-                printf("Tamanho de peça não disponível.\n");
-            } else if (!valid_position(game, size, column, direction)) {
-                printf("Posição irregular.\n");
-            } else {
-                int* lines = malloc(sizeof(int) * size);
-                int* columns = malloc(sizeof(int) * size);
-                drop(game, name, size, column, direction, lines, columns);
-                bool player_won = false;
-                for (int i = 0; i < size; i++) {
-                    if (player_wins(game, name, lines[i], columns[i])) {
-                        game_over(game, name, NULL);
-                        player_won = true;
-                        printf("Sequência conseguida. Jogo terminado.\n");
-                        break;
-                    }
-                }
-                if (!player_won) {
-                    printf("Peça colocada.\n");
-                }
-                free(lines);
-                free(columns);
-            }
-        } else if (strcmp(command, "VR") == 0) {
-            if (!in_game(game)) {
-                printf("Não existe jogo em curso.\n");
-            } else {
-                for (int r = 0; r < game->height; r++) {
-                    for (int c = 0; c < game->width; c++) {
-                        printf("%d %d ", r + 1, c + 1);
-                        if (game->board[r][c] == NULL) {
-                            printf("Vazio\n");
-                        } else {
-                            printf("%s\n", game->board[r][c]->player->name);
-                        }
-                    }
-                }
-            }
-        } else if (strcmp(command, "G") == 0) {
-            save_game(game, "game.data");
-            printf("Jogo gravado.\n");
-        } else if (strcmp(command, "L") == 0) {
-            free_game(game);
-            game = load_game("game.data");
-            printf("Jogo carregado.\n");
-        } else if (strcmp(command, "X") == 0) {
-            if (!in_game(game)) {
-                printf("Não existe jogo em curso.\n");
-            } else {
-                for (int l = 0; l < game->height; l++) {
-                    for (int c = 0; c < game->width; c++) {
-                        if (game->board[l][c] != NULL) {
-                            printf("%8s", game->board[l][c]->player->name);
-                        } else {
-                            printf("%8s", "----");
-                        }
-                    }
-                    printf("\n");
-                }
-            }
-        } else {
-            printf("Instrução inválida.\n");
+        mem_set_limit(atol(argv[2]));
+        argc -= 2;
+        argv += 2;
+    }
+    char* archive_file = NULL;
+    if (argc >= 3 && strcmp(argv[1], "-a") == 0) {
+        archive_file = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+    if (argc >= 2 && strcmp(argv[1], "-t") == 0) {
+        return generate_tablebase(argc - 2, argv + 2);
+    }
+    map_tablebase(&tablebase, TABLEBASE_FILE);
+    if (argc >= 2 && strcmp(argv[1], "-d") == 0) {
+        int failed = run_differential(argc - 2, argv + 2);
+        unmap_tablebase(&tablebase);
+        return failed;
+    }
+    if (argc >= 3 && strcmp(argv[1], "-b") == 0) {
+        int num_threads = argc >= 4 ? atoi(argv[3]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        int failed = run_batch(argv[2], num_threads);
+        unmap_tablebase(&tablebase);
+        return failed == 0 ? 0 : 1;
+    }
+    if (argc >= 3 && strcmp(argv[1], "-r") == 0) {
+        long divergences = replay_trace(argv[2], argc >= 4 ? atof(argv[3]) : 1);
+        if (divergences < 0) {
+            fprintf(stderr, "Ocorreu um erro ao repetir %s.\n", argv[2]);
         }
-        free(line);
-        line = NULL;
+        unmap_tablebase(&tablebase);
+        return divergences == 0 ? 0 : 1;
     }
-    if (line != NULL) {
-        free(line);
+    tTrace trace;
+    tSession session = {.in = stdin, .out = stdout, .data_file = "game.data", .archive_file = archive_file};
+    if (argc >= 3 && strcmp(argv[1], "-c") == 0) {
+        if (!start_capture(&trace, argv[2], stdout)) {
+            fprintf(stderr, "Ocorreu um erro ao criar %s.\n", argv[2]);
+            unmap_tablebase(&tablebase);
+            return 1;
+        }
+        session.trace = &trace;
+    }
+    run_session(&session);
+    if (session.trace != NULL) {
+        stop_trace(&trace);
     }
-    free_game(game);
+    stop_spectators(stdout);
+    unmap_tablebase(&tablebase);
     return 0;
 }